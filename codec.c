@@ -0,0 +1,279 @@
+#include "codec.h"
+
+/**
+  @brief The running sum each block starts with (a Rice parameter of 4).
+  */
+static const uint32_t kInitialSum = 16;
+
+/**
+  @brief The number of differences after which the running sum is halved.
+  @note Halving lets the Rice parameter follow the signal within a heartbeat.
+  */
+static const uint16_t kAdaptPeriod = 16;
+
+/**
+  @brief The largest Rice parameter.
+  */
+static const uint16_t kMaxRiceParameter = 15;
+
+/**
+  @brief A reader of the bits of a block, most significant first.
+  */
+typedef struct {
+  const uint8_t* data;
+  uint16_t size;
+  uint16_t position;      // The next byte to load.
+  uint32_t bits;          // The loaded bits, aligned to the top. Zero below.
+  uint16_t num_bits;      // Number of loaded bits.
+  uint32_t num_read_bits; // Number of bits read.
+} BitReader;
+
+/**
+  @brief Return the Rice parameter for the running mean of the differences.
+  @note The smallest k with n * 2^k >= sum, as in LOCO-I.
+  */
+static uint16_t GetRiceParameter(uint32_t sum, uint16_t n)
+{
+  uint16_t k;
+
+  k = 0;
+  while (((uint32_t)n << k) < sum && k < kMaxRiceParameter)
+  {
+    ++k;
+  }
+
+  return k;
+}
+
+/**
+  @brief Add the difference to the running sum.
+  */
+static void Adapt(uint32_t* sum, uint16_t* n, uint16_t value)
+{
+  *sum += value;
+  ++*n;
+  if (kAdaptPeriod <= *n)
+  {
+    *sum >>= 1;
+    *n >>= 1;
+  }
+}
+
+/**
+  @brief Append the lowest count bits of value (count <= 16) to the block.
+  */
+static void PutBits(codec_encoder_t* encoder, uint16_t value, uint16_t count)
+{
+  encoder->bits = (encoder->bits << count) | value;
+  encoder->num_bits += count;
+
+  while (8 <= encoder->num_bits)
+  {
+    encoder->num_bits -= 8;
+    encoder->data[encoder->size++] = encoder->bits >> encoder->num_bits;
+  }
+}
+
+void codec_encoder_init(codec_encoder_t* encoder, uint8_t* data)
+{
+  encoder->data = data;
+  encoder->size = CODEC_HEADER_SIZE;
+  encoder->count = 0;
+  encoder->previous = 0;
+  encoder->sum = kInitialSum;
+  encoder->n = 1;
+  encoder->bits = 0;
+  encoder->num_bits = 0;
+}
+
+uint16_t codec_encode(codec_encoder_t* encoder, uint16_t sample)
+{
+  uint16_t difference;
+  uint16_t value;
+  uint16_t k;
+  uint16_t q;
+
+  if (0 == encoder->count)
+  {
+    encoder->data[2] = sample;
+    encoder->data[3] = sample >> 8;
+  }
+  else
+  {
+    // Zigzag map the difference so small differences of either sign are
+    // small values.
+    difference = sample - encoder->previous;
+    value = (difference << 1) ^ ((difference & 0x8000) ? 0xFFFF : 0);
+
+    k = GetRiceParameter(encoder->sum, encoder->n);
+    q = value >> k;
+
+    if (CODEC_ESCAPE_QUOTIENT <= q)
+    {
+      PutBits(encoder, 0xFFFF, CODEC_ESCAPE_QUOTIENT);
+      PutBits(encoder, value, 16);
+    }
+    else
+    {
+      // q one bits and a zero bit.
+      PutBits(encoder, ((1U << q) - 1) << 1, q + 1);
+      PutBits(encoder, value & ((1U << k) - 1), k);
+    }
+
+    Adapt(&encoder->sum, &encoder->n, value);
+  }
+
+  encoder->previous = sample;
+  encoder->count++;
+
+  if (CODEC_BLOCK_SIZE <= encoder->count)
+  {
+    return codec_encoder_finish(encoder);
+  }
+
+  return 0;
+}
+
+uint16_t codec_encoder_finish(codec_encoder_t* encoder)
+{
+  if (0 == encoder->count)
+  {
+    return 0;
+  }
+
+  // Pad the last byte with zero bits.
+  if (encoder->num_bits)
+  {
+    PutBits(encoder, 0, 8 - encoder->num_bits);
+  }
+
+  encoder->data[0] = encoder->count;
+  encoder->data[1] = encoder->count >> 8;
+
+  return encoder->size;
+}
+
+/**
+  @brief Load whole bytes into the reader until it holds more than 24 bits.
+  */
+static void FillBits(BitReader* reader)
+{
+  while (reader->num_bits <= 24 && reader->position < reader->size)
+  {
+    reader->bits |= (uint32_t)reader->data[reader->position++] << (24 - reader->num_bits);
+    reader->num_bits += 8;
+  }
+}
+
+/**
+  @brief Read count bits (1 <= count <= 16) that are known to be loaded.
+  */
+static uint16_t ReadBits(BitReader* reader, uint16_t count)
+{
+  uint16_t value;
+
+  value = reader->bits >> (32 - count);
+  reader->bits <<= count;
+  reader->num_bits -= count;
+  reader->num_read_bits += count;
+
+  return value;
+}
+
+uint16_t codec_decode_block(const uint8_t* data, uint16_t size,
+                            uint16_t* samples, uint16_t max_samples,
+                            uint16_t* num_samples)
+{
+  BitReader reader;
+  uint32_t sum;
+  uint16_t n;
+  uint16_t count;
+  uint16_t previous;
+  uint16_t value;
+  uint16_t k;
+  uint16_t q;
+  uint16_t i;
+
+  *num_samples = 0;
+
+  if (size < CODEC_HEADER_SIZE)
+  {
+    return 0;
+  }
+
+  count = data[0] | (data[1] << 8);
+  if (0 == count || max_samples < count)
+  {
+    return 0;
+  }
+
+  previous = data[2] | (data[3] << 8);
+  samples[0] = previous;
+
+  reader.data = data;
+  reader.size = size;
+  reader.position = CODEC_HEADER_SIZE;
+  reader.bits = 0;
+  reader.num_bits = 0;
+  reader.num_read_bits = 0;
+
+  sum = kInitialSum;
+  n = 1;
+
+  for (i = 1; i < count; ++i)
+  {
+    // A code has at most 16 bits of prefix and 16 bits of value. Unloaded
+    // bits are zero, so the prefix stops at the end of the loaded bits.
+    FillBits(&reader);
+    q = 0;
+    while (q < CODEC_ESCAPE_QUOTIENT && (reader.bits & 0x80000000UL))
+    {
+      reader.bits <<= 1;
+      ++q;
+    }
+
+    if (reader.num_bits < q + (q < CODEC_ESCAPE_QUOTIENT))
+    {
+      return 0;
+    }
+    reader.num_bits -= q;
+    reader.num_read_bits += q;
+
+    k = GetRiceParameter(sum, n);
+
+    if (CODEC_ESCAPE_QUOTIENT <= q)
+    {
+      FillBits(&reader);
+      if (reader.num_bits < 16)
+      {
+        return 0;
+      }
+      value = ReadBits(&reader, 16);
+    }
+    else
+    {
+      // Skip the zero bit.
+      ReadBits(&reader, 1);
+      value = q << k;
+
+      if (k)
+      {
+        FillBits(&reader);
+        if (reader.num_bits < k)
+        {
+          return 0;
+        }
+        value |= ReadBits(&reader, k);
+      }
+    }
+
+    Adapt(&sum, &n, value);
+
+    previous += (value >> 1) ^ (0 - (value & 1));
+    samples[i] = previous;
+  }
+
+  *num_samples = count;
+
+  return CODEC_HEADER_SIZE + (uint16_t)((reader.num_read_bits + 7) >> 3);
+}
@@ -0,0 +1,99 @@
+#ifndef CODEC_H_
+#define CODEC_H_
+
+#include <stdint.h>
+
+// Lossless compression of the ADC sample stream.
+// The samples are cut into blocks of CODEC_BLOCK_SIZE samples that can each
+// be decoded on their own:
+//
+//   offset  size      field
+//   0       2         number of samples (n)
+//   2       2         first sample
+//   4       ...       n - 1 Rice codes of the differences, padded to a byte
+//
+// The header words are little-endian. Each difference from the previous
+// sample is zigzag mapped (0, -1, 1, -2, ... to 0, 1, 2, 3, ...) and Rice
+// coded with a parameter k that adapts to the running mean of the mapped
+// differences, so no parameters are stored. A code is q one bits, a zero bit
+// and the low k bits of the value, where q is the value >> k. Values with
+// q >= CODEC_ESCAPE_QUOTIENT are sent as CODEC_ESCAPE_QUOTIENT one bits and
+// the 16-bit value instead. The bits are written most significant first.
+
+/**
+  @brief The number of samples in a full block.
+  */
+#define CODEC_BLOCK_SIZE 64
+
+/**
+  @brief The size of the block header in bytes.
+  */
+#define CODEC_HEADER_SIZE 4
+
+/**
+  @brief The quotient that escapes to a 16-bit value.
+  */
+#define CODEC_ESCAPE_QUOTIENT 16
+
+/**
+  @brief The largest size of an encoded block of num_samples samples in bytes.
+  @note Each difference takes at most CODEC_ESCAPE_QUOTIENT + 16 bits.
+  */
+#define CODEC_MAX_BLOCK_BYTES(num_samples) \
+  (CODEC_HEADER_SIZE + ((num_samples) * (CODEC_ESCAPE_QUOTIENT + 16) + 7) / 8)
+
+/**
+  @brief The state of the encoder of the current block.
+  */
+typedef struct {
+  uint8_t* data;      // The block being written.
+  uint16_t size;      // Number of complete bytes in data.
+  uint16_t count;     // Number of samples in the block.
+  uint16_t previous;  // The previous sample.
+  uint32_t sum;       // Running sum of the mapped differences.
+  uint16_t n;         // Number of differences in sum.
+  uint32_t bits;      // Bits not yet written to data (the lowest num_bits).
+  uint16_t num_bits;  // Number of bits in bits.
+} codec_encoder_t;
+
+/**
+  @brief Start a new block.
+  @param encoder   The encoder.
+  @param data      The block, CODEC_MAX_BLOCK_BYTES(CODEC_BLOCK_SIZE) bytes.
+  */
+void codec_encoder_init(codec_encoder_t* encoder, uint8_t* data);
+
+/**
+  @brief Add a sample to the block.
+  @param encoder   The encoder.
+  @param sample    The sample.
+  @return The size of the block in bytes once it holds CODEC_BLOCK_SIZE
+          samples, otherwise 0. Start the next block with codec_encoder_init.
+  @note Takes a constant number of steps per bit, so it can run in the ADC
+        interrupt.
+  */
+uint16_t codec_encode(codec_encoder_t* encoder, uint16_t sample);
+
+/**
+  @brief Finish a partial block.
+  @param encoder   The encoder.
+  @return The size of the block in bytes or 0 if it holds no samples.
+  */
+uint16_t codec_encoder_finish(codec_encoder_t* encoder);
+
+/**
+  @brief Decode one block.
+  @param data         The encoded block.
+  @param size         The number of bytes available in data.
+  @param samples      The decoded samples.
+  @param max_samples  The number of samples that fit in samples.
+  @param num_samples  Set to the number of decoded samples.
+  @return The size of the block in bytes or 0 if the block is malformed,
+          truncated or too long for samples.
+  @note The samples can be passed straight to the filters in qrs.h.
+  */
+uint16_t codec_decode_block(const uint8_t* data, uint16_t size,
+                            uint16_t* samples, uint16_t max_samples,
+                            uint16_t* num_samples);
+
+#endif // CODEC_H_
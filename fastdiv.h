@@ -0,0 +1,72 @@
+#ifndef FASTDIV_H_
+#define FASTDIV_H_
+
+#include <stdint.h>
+
+// Division-free arithmetic.
+// The MSP430F5529 has a hardware multiplier but no hardware divider, so each
+// / or % is a call into a shift-and-subtract library routine. The functions
+// here replace the divisions on the detection and display paths with a
+// multiply and a shift. Divisions by a constant of a table generator are
+// evaluated by the compiler.
+
+/**
+  @brief Shift of the 16-bit fixed point reciprocals.
+  */
+#define FASTDIV_RECIPROCAL_SHIFT 16
+
+/**
+  @brief The 16-bit fixed point reciprocal of divisor, rounded up.
+  @note A constant expression for generating reciprocal tables.
+        fastdiv_divide(n, FASTDIV_RECIPROCAL(d)) equals n / d whenever
+        n * (d - 1) < 65536.
+  */
+#define FASTDIV_RECIPROCAL(divisor) \
+  ((uint32_t)((0x10000UL + (divisor) - 1) / (divisor)))
+
+/**
+  @brief Divide by multiplying with a fixed point reciprocal.
+  @param  dividend    The dividend.
+  @param  reciprocal  FASTDIV_RECIPROCAL of the divisor.
+  @return The quotient, rounded down within the range of FASTDIV_RECIPROCAL.
+  */
+static inline uint16_t fastdiv_divide(uint16_t dividend, uint32_t reciprocal)
+{
+  return (dividend * reciprocal) >> FASTDIV_RECIPROCAL_SHIFT;
+}
+
+/**
+  @brief Divide by ten and return the remainder.
+  @param  value      The dividend.
+  @param  remainder  Set to value % 10.
+  @return value / 10.
+  @note Exact for every 16-bit value. 0xCCCD / 2^19 is 1 / 10 rounded up.
+  */
+static inline uint16_t fastdiv_divmod10(uint16_t value, uint8_t* remainder)
+{
+  uint16_t quotient;
+
+  quotient = ((uint32_t)value * 0xCCCDU) >> 19;
+  *remainder = value - quotient * 10;
+
+  return quotient;
+}
+
+/**
+  @brief Divide a 32-bit value by ten and return the remainder.
+  @param  value      The dividend.
+  @param  remainder  Set to value % 10.
+  @return value / 10.
+  @note Exact for every 32-bit value. 0xCCCCCCCD / 2^35 is 1 / 10 rounded up.
+  */
+static inline uint32_t fastdiv_divmod10_long(uint32_t value, uint8_t* remainder)
+{
+  uint32_t quotient;
+
+  quotient = ((uint64_t)value * 0xCCCCCCCDUL) >> 35;
+  *remainder = value - quotient * 10;
+
+  return quotient;
+}
+
+#endif // FASTDIV_H_
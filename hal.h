@@ -0,0 +1,143 @@
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <stdint.h>
+
+// The hardware abstraction layer used by main.c.
+// On the MSP430 the functions are implemented in hal_msp430.c and the
+// interrupt helpers are macros so they expand inside the interrupt service
+// routine. On a host the functions are implemented by the simulation
+// backend in host/hal_sim.c.
+
+#ifdef __MSP430__
+
+#include <msp430.h>
+
+/**
+  @brief Read the result of the last ADC conversion.
+  */
+#define hal_read_adc() (ADC12MEM0)
+
+/**
+  @brief Start an ADC conversion.
+  @note The ADC interrupt is raised when the conversion completes.
+  */
+#define hal_start_adc_conversion() (ADC12CTL0 |= ADC12SC)
+
+/**
+  @brief Toggle the LCD bias by inverting common and all segment pins.
+  */
+#define hal_toggle_display() \
+  do                         \
+  {                          \
+    P4OUT ^= 0x01;           \
+    P2OUT ^= 0xFF;           \
+    P6OUT ^= 0xFF;           \
+    P3OUT ^= 0xFF;           \
+  } while (0)
+
+/**
+  @brief Enable interrupts.
+  */
+#define hal_enable_interrupts() __bis_SR_register(GIE)
+
+/**
+  @brief Enter LOW_POWER_MODE (see main.h) until an interrupt wakes the CPU.
+  */
+#define hal_enter_low_power_mode() __bis_SR_register(LOW_POWER_MODE)
+
+/**
+  @brief Wake the CPU from LOW_POWER_MODE when the current interrupt returns.
+  @note Must be used inside an interrupt service routine.
+  */
+#define hal_exit_low_power_mode_on_exit() __bic_SR_register_on_exit(LOW_POWER_MODE)
+
+#else
+
+// Interrupt service routines are plain functions on the host. main.c is
+// built with -Dmain=hal_sim_firmware_main so the simulator can provide main.
+#define __interrupt
+
+uint16_t hal_read_adc(void);
+void hal_start_adc_conversion(void);
+void hal_toggle_display(void);
+void hal_enable_interrupts(void);
+void hal_enter_low_power_mode(void);
+void hal_exit_low_power_mode_on_exit(void);
+
+#endif // __MSP430__
+
+/**
+  @brief Stop the watchdog, drive all pins low and disable USB.
+  @note This must be called before any other pins are set up.
+  */
+void hal_init_board(void);
+
+/**
+  @brief Initializes the ADC converter.
+  */
+void hal_init_adc(void);
+
+/**
+  @brief Initializes the timer that starts the QRS detector.
+  @param period  The period of the timer in seconds.
+  */
+void hal_init_detector_timer(uint16_t period);
+
+/**
+  @brief Initializes the pins used to drive the display.
+  */
+void hal_init_display_driver(void);
+
+/**
+  @brief Initializes the timer used to refresh the display.
+  @param frequency  The refresh frequency in Hz.
+  */
+void hal_init_display_timer(uint16_t frequency);
+
+/**
+  @brief Initializes the timer that starts each ADC conversion.
+  @param frequency  The sampling frequency in Hz.
+  */
+void hal_init_sampler_timer(uint16_t frequency);
+
+/**
+  @brief Start the free running cycle counter used for profiling.
+  @note Uses Timer B0 on the MSP430.
+  */
+void hal_init_cycle_counter(void);
+
+/**
+  @brief Read the cycle counter.
+  @return CPU cycles on the MSP430 (SMCLK, which runs with MCLK by default)
+          and nanoseconds on the host. Wraps at 32 bits.
+  @note May be called from an interrupt service routine.
+  */
+uint32_t hal_read_cycle_counter(void);
+
+/**
+  @brief Initializes the serial port the binary trace is sent through.
+  @note UCA1 (TXD on P4.4) at 115200 baud on the MSP430.
+  */
+void hal_init_trace(void);
+
+/**
+  @brief Send a block of the binary trace.
+  @param data      The bytes to send.
+  @param size      The number of bytes.
+  @note Returns once the block is sent. On the MSP430 the block is sent by
+        DMA while the CPU waits in low power mode, so interrupts and
+        sampling keep running. Must not be called from an interrupt service
+        routine.
+  */
+void hal_trace_write(const void* data, uint16_t size);
+
+/**
+  @brief Drive the segments of the three LCD digits.
+  @param first   The seven segment pattern of the first (ones) digit.
+  @param second  The seven segment pattern of the second (tens) digit.
+  @param third   The segment pattern of the third (hundreds) digit.
+  */
+void hal_set_display_segments(uint8_t first, uint8_t second, uint8_t third);
+
+#endif // HAL_H_
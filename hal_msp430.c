@@ -0,0 +1,253 @@
+#include "hal.h"
+
+/**
+  @brief Initialize all pins as output and output low.
+  @notes This is done to ensure that there are no floating inputs.
+         This should be called before setting any other pins.
+  */
+static void set_pins_to_output_low(void)
+{
+  P1DIR = 0xFF;
+  P2DIR = 0xFF;
+  P3DIR = 0xFF;
+  P4DIR = 0xFF;
+  P5DIR = 0xFF;
+  P6DIR = 0xFF;
+  P7DIR = 0xFF;
+  P8DIR = 0xFF;
+  PJDIR = 0xFF;
+
+  P1OUT = 0x00;
+  P2OUT = 0x00;
+  P3OUT = 0x00;
+  P4OUT = 0x00;
+  P5OUT = 0x00;
+  P6OUT = 0x00;
+  P7OUT = 0x00;
+  P8OUT = 0x00;
+  PJOUT = 0x00;
+}
+
+/**
+  @brief Disables the USB component.
+  */
+static void disable_usb(void)
+{
+  USBKEYPID = USBKEY;    // Enable access to USB config registers.
+  USBPWRCTL &= ~VUSBEN;  // Disable the VUSB LDO.
+  USBPWRCTL &= ~SLDOEN;  // Disable the VUSB SLDO.
+  USBKEYPID = 0x9600;    // Disable access to USB config registers.
+}
+
+void hal_init_board(void)
+{
+  // Stop watchdog timer.
+  WDTCTL = WDTPW | WDTHOLD;
+
+  // Setting pins to low must be before any setup of other pins.
+  set_pins_to_output_low();
+  disable_usb();
+}
+
+void hal_init_adc(void)
+{
+  P7DIR &= ~BIT0;                 // Set P7.0 as input.
+  P7SEL |= BIT0;                  // ADC option select A12 (P7.0).
+
+  ADC12CTL0 = ADC12SHT02 |        // 64 CLK cycles sampling time.
+              ADC12ON;            // ADC12 on.
+  ADC12CTL1 = ADC12CSTARTADD_0 |  // ADC12 Conversion Start Address 0.
+              ADC12SSEL_3      |  // SMCLK.
+              ADC12SHP;           // Sample/Hold Pulse Mode.
+  ADC12MCTL0 = ADC12INCH_12;      // Use A12 (P7.0) as input
+
+  ADC12IE = ADC12IE0;             // Enable interrupt on ADC12IE0.
+  ADC12CTL0 |= ADC12ENC;          // Enable conversion.
+}
+
+void hal_init_detector_timer(uint16_t period)
+{
+  TA0CCR0 = (32768 >> 3) * period;
+
+  TA0CTL = TASSEL_1 |  // ACLK (32768 Hz)
+           ID_3     |  // Clock divider. Divide by 8 (2^3).
+           MC_1     |  // Up to TA0CCR0.
+           TACLR;      // Clear timer.
+
+  TA0CCTL0 = CCIE;     // Enable interrupt on TA0CCR0.
+}
+
+void hal_init_display_driver(void)
+{
+  // Set pins to output direction.
+  P4DIR |= 0x01;  // P4.0.
+  P3DIR |= 0x7F;  // P3.0 to  P3.6 (First Digit).
+  P6DIR |= 0x7F;  // P6.0 to  P6.6 (Second Digit).
+  P2DIR |= 0x05;  // P2.0 and P2.2 (Third Digit).
+}
+
+void hal_init_display_timer(uint16_t frequency)
+{
+  TA2CCR0 = (32768 >> 3) / frequency;
+
+  TA2CTL = TASSEL_1 |  // ACLK (32768 Hz)
+           ID_3     |  // Clock divider. Divide by 8 (2^3).
+           MC_1     |  // Up to TA2CCR0.
+           TACLR;      // Clear timer.
+
+  TA2CCTL0 = CCIE;     // Enable interrupt on TA2CCR0.
+}
+
+void hal_init_sampler_timer(uint16_t frequency)
+{
+  // The timer is undivided so the period can be rounded to within one ACLK
+  // cycle of the sampling frequency (e.g. 360 Hz and 500 Hz). Up mode counts
+  // from zero to TA1CCR0 inclusive.
+  TA1CCR0 = (32768 + frequency / 2) / frequency - 1;
+
+  TA1CTL = TASSEL_1 |  // ACLK (32768 Hz)
+           ID_0     |  // No clock divider.
+           MC_1     |  // Up to TA1CCR0.
+           TACLR;      // Clear timer.
+
+  TA1CCTL0 = CCIE;     // Enable interrupt on TA1CCR0.
+}
+
+/**
+  @brief The upper 16 bits of the cycle counter.
+  */
+static volatile uint16_t cycle_counter_high = 0;
+
+/**
+  @brief Timer B0 overflow interrupt service routine to extend the cycle counter.
+  */
+#pragma vector=TIMER0_B1_VECTOR
+__interrupt void extend_cycle_counter(void)
+{
+  if (TB0IV_TBIFG == TB0IV)  // Reading TB0IV clears the flag.
+  {
+    cycle_counter_high++;
+  }
+}
+
+void hal_init_cycle_counter(void)
+{
+  TB0CTL = TBSSEL_2 |  // SMCLK
+           ID_0     |  // No clock divider.
+           MC_2     |  // Continuous up to 0xFFFF.
+           TBCLR    |  // Clear timer.
+           TBIE;       // Enable interrupt on overflow.
+}
+
+uint32_t hal_read_cycle_counter(void)
+{
+  uint16_t sr;
+  uint16_t high;
+  uint16_t low;
+
+  sr = __get_SR_register();
+  __disable_interrupt();
+
+  high = cycle_counter_high;
+  low = TB0R;
+
+  // The overflow is still pending if interrupts were already disabled
+  // (e.g. in an interrupt service routine).
+  if ((TB0CTL & TBIFG) && low < 0x8000)
+  {
+    high++;
+  }
+
+  if (sr & GIE)
+  {
+    __enable_interrupt();
+  }
+
+  return ((uint32_t)high << 16) | low;
+}
+
+/**
+  @brief Set while a block of the binary trace is being sent.
+  */
+static volatile uint16_t is_trace_busy = 0;
+
+/**
+  @brief DMA interrupt service routine for the end of a trace block.
+  */
+#pragma vector=DMA_VECTOR
+__interrupt void finish_trace_block(void)
+{
+  if (DMAIV_DMA0IFG == DMAIV)  // Reading DMAIV clears the flag.
+  {
+    is_trace_busy = 0;
+
+    // Clear low power mode to wake up CPU.
+    __bic_SR_register_on_exit(LPM0_bits);
+  }
+}
+
+void hal_init_trace(void)
+{
+  P4SEL |= BIT4;                  // UCA1TXD on P4.4 (default port mapping).
+
+  UCA1CTL1 = UCSWRST |            // Hold in reset while configuring.
+             UCSSEL_2;            // SMCLK (1048576 Hz).
+  UCA1BR0 = 9;                    // 1048576 / 115200 = 9.1.
+  UCA1BR1 = 0;
+  UCA1MCTL = UCBRS_1 |            // Second modulation stage.
+             UCBRF_0;
+  UCA1CTL1 &= ~UCSWRST;           // Release for operation.
+
+  DMACTL0 = DMA0TSEL_21;          // Trigger DMA0 on UCA1TXIFG.
+}
+
+void hal_trace_write(const void* data, uint16_t size)
+{
+  if (0 == size)
+  {
+    return;
+  }
+
+  is_trace_busy = 1;
+
+  __data16_write_addr((unsigned short)&DMA0SA, (unsigned long)data);
+  __data16_write_addr((unsigned short)&DMA0DA, (unsigned long)&UCA1TXBUF);
+  DMA0SZ = size;
+  DMA0CTL = DMADT_0       |       // Single transfer per trigger.
+            DMASRCINCR_3  |       // Increment the source address.
+            DMADSTINCR_0  |       // Fixed destination address.
+            DMASBDB       |       // Byte to byte.
+            DMAEN         |       // Enable DMA.
+            DMAIE;                // Enable interrupt at the end of the block.
+
+  // The DMA of the block before ends once its last byte is written into
+  // UCA1TXBUF, not once it is sent. Wait for UCA1TXBUF to empty so the
+  // first byte of this block does not overwrite it.
+  while (!(UCA1IFG & UCTXIFG));
+
+  // UCTXIFG is now set. Toggle it so the DMA sees an edge and starts.
+  UCA1IFG &= ~UCTXIFG;
+  UCA1IFG |= UCTXIFG;
+
+  // Sleep until the block is sent. Interrupts are disabled between the
+  // check and entering low power mode so the wake up cannot be missed.
+  // LPM0 keeps SMCLK running for the UART.
+  __disable_interrupt();
+  while (is_trace_busy)
+  {
+    __bis_SR_register(LPM0_bits | GIE);
+    __disable_interrupt();
+  }
+  __enable_interrupt();
+}
+
+void hal_set_display_segments(uint8_t first, uint8_t second, uint8_t third)
+{
+  // Drive common to ground.
+  P4OUT = 0x00;
+
+  // Drive desired segments to high.
+  P2OUT = third;
+  P6OUT = second;
+  P3OUT = first;
+}
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "codec.h"
+
+/**
+  @brief Read an ECG file of unsigned samples separated by whitespace or commas.
+  @param  file         The ECG file.
+  @param  num_samples  Set to the number of samples.
+  @return The samples or NULL if there are none.
+  */
+static uint16_t* ReadText(FILE* file, uint32_t* num_samples)
+{
+  uint16_t* samples;
+  uint32_t capacity;
+  uint32_t length;
+  uint32_t value;
+  uint16_t has_digit;
+  int c;
+
+  capacity = 4096;
+  length = 0;
+  samples = malloc(capacity * sizeof(uint16_t));
+
+  value = 0;
+  has_digit = 0;
+
+  do
+  {
+    c = fgetc(file);
+
+    if (c >= '0' && c <= '9')
+    {
+      value = value * 10 + (c - '0');
+      has_digit = 1;
+    }
+    else if (has_digit)
+    {
+      if (length == capacity)
+      {
+        capacity *= 2;
+        samples = realloc(samples, capacity * sizeof(uint16_t));
+      }
+
+      samples[length++] = (uint16_t)value;
+      value = 0;
+      has_digit = 0;
+    }
+  } while (EOF != c);
+
+  if (0 == length)
+  {
+    free(samples);
+    return NULL;
+  }
+
+  *num_samples = length;
+
+  return samples;
+}
+
+/**
+  @brief Compress a text ECG file into a stream of blocks (see codec.h).
+  */
+static int Compress(FILE* in, FILE* out)
+{
+  static uint8_t block[CODEC_MAX_BLOCK_BYTES(CODEC_BLOCK_SIZE)];
+  static uint16_t decoded[CODEC_BLOCK_SIZE];
+  codec_encoder_t encoder;
+  uint16_t* samples;
+  uint32_t num_samples;
+  uint32_t num_bytes;
+  uint32_t start;
+  uint32_t i;
+  uint16_t size;
+  uint16_t num_decoded;
+
+  samples = ReadText(in, &num_samples);
+  if (NULL == samples)
+  {
+    fprintf(stderr, "no samples\n");
+    return 1;
+  }
+
+  num_bytes = 0;
+  start = 0;
+  codec_encoder_init(&encoder, block);
+
+  for (i = 0; i < num_samples; ++i)
+  {
+    size = codec_encode(&encoder, samples[i]);
+    if (i + 1 == num_samples && 0 == size)
+    {
+      size = codec_encoder_finish(&encoder);
+    }
+    if (0 == size)
+    {
+      continue;
+    }
+
+    // Check every block before it is written.
+    if (size != codec_decode_block(block, size, decoded, CODEC_BLOCK_SIZE, &num_decoded) ||
+        num_decoded != i + 1 - start ||
+        memcmp(decoded, &samples[start], num_decoded * sizeof(uint16_t)))
+    {
+      fprintf(stderr, "block at sample %u does not decode\n", start);
+      free(samples);
+      return 1;
+    }
+
+    fwrite(block, 1, size, out);
+    num_bytes += size;
+    start = i + 1;
+    codec_encoder_init(&encoder, block);
+  }
+
+  fprintf(stderr, "%u samples, %u bytes, %.2f bits per sample, %.2fx smaller than 16-bit\n",
+          num_samples, num_bytes, num_bytes * 8.0 / num_samples,
+          num_samples * 2.0 / num_bytes);
+
+  free(samples);
+
+  return 0;
+}
+
+/**
+  @brief Decompress a stream of blocks into a text ECG file.
+  */
+static int Decompress(FILE* in, FILE* out)
+{
+  static uint16_t samples[CODEC_BLOCK_SIZE];
+  uint8_t* data;
+  uint32_t capacity;
+  uint32_t length;
+  uint32_t position;
+  uint32_t available;
+  uint16_t size;
+  uint16_t num_samples;
+  uint16_t i;
+
+  capacity = 0x10000;
+  length = 0;
+  data = malloc(capacity);
+  while (0 != (size = fread(data + length, 1, capacity - length, in)))
+  {
+    length += size;
+    if (length == capacity)
+    {
+      capacity *= 2;
+      data = realloc(data, capacity);
+    }
+  }
+
+  position = 0;
+  while (position < length)
+  {
+    available = length - position;
+    size = codec_decode_block(data + position,
+                              (available > 0xFFFF) ? 0xFFFF : available,
+                              samples, CODEC_BLOCK_SIZE, &num_samples);
+    if (0 == size)
+    {
+      fprintf(stderr, "bad block at byte %u\n", position);
+      free(data);
+      return 1;
+    }
+
+    for (i = 0; i < num_samples; ++i)
+    {
+      fprintf(out, "%u\n", samples[i]);
+    }
+    position += size;
+  }
+
+  free(data);
+
+  return 0;
+}
+
+/**
+  @brief Compress (-c) or decompress (-d) an ECG recording.
+  @note Compressing reads unsigned samples separated by whitespace or commas
+        and writes the blocks of codec.h. Decompressing writes one sample per
+        line.
+  */
+int main(int argc, char** argv)
+{
+  FILE* in;
+  FILE* out;
+  int result;
+
+  if (argc < 4 || argv[1][0] != '-' || (argv[1][1] != 'c' && argv[1][1] != 'd'))
+  {
+    fprintf(stderr, "usage: %s -c|-d <in_file> <out_file>\n", argv[0]);
+    return 1;
+  }
+
+  in = fopen(argv[2], "rb");
+  if (NULL == in)
+  {
+    perror(argv[2]);
+    return 1;
+  }
+
+  out = fopen(argv[3], "wb");
+  if (NULL == out)
+  {
+    perror(argv[3]);
+    fclose(in);
+    return 1;
+  }
+
+  result = ('c' == argv[1][1]) ? Compress(in, out) : Decompress(in, out);
+
+  fclose(in);
+  fclose(out);
+
+  return result;
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "ecg_synth.h"
+
+// The number of samples generated at a time.
+#define BLOCK_SIZE 4096
+
+/**
+  @brief Return a monotonic wall clock time in nanoseconds.
+  */
+static uint64_t GetWallNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+  @brief Print the usage and the defaults.
+  */
+static void PrintUsage(const char* name, const ecg_synth_params_t* params)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -n seconds       duration (default 60)\n"
+          "  -c channels      channels, seeded seed, seed + 1, ... (default 1)\n"
+          "  -t               time the generator instead of printing samples\n"
+          "  -s seed          seed (default %u)\n"
+          "  -f hz            sampling frequency (default %u)\n"
+          "  -r bpm           heart rate (default %u)\n"
+          "  -v ms            RR standard deviation (default %u)\n"
+          "  -b counts        baseline (default %u)\n"
+          "  -a counts        R wave height (default %u)\n"
+          "  -w counts        baseline wander (default %u)\n"
+          "  -m counts        mains interference (default %u)\n"
+          "  -l hz            mains frequency (default %u)\n"
+          "  -e counts        white noise (default %u)\n"
+          "  -x counts        largest motion artifact (default %u)\n"
+          "  -p per_hour      motion artifacts per hour (default %u)\n",
+          name, params->seed, params->frequency, params->heartrate, params->hrv,
+          params->baseline, params->amplitude, params->wander, params->mains,
+          params->mains_frequency, params->noise, params->artifact,
+          params->artifacts_per_hour);
+}
+
+/**
+  @brief Generate synthetic ECG and print it as text, one row of samples per
+         line with a column per channel, in the format hal_sim and ecg_codec
+         read. With -t, the channels are only generated, and the time taken
+         and the number of channels that could run in real time are printed.
+  */
+int main(int argc, char** argv)
+{
+  static uint16_t block[BLOCK_SIZE];
+  ecg_synth_params_t params;
+  ecg_synth_t* synths;
+  uint16_t** blocks;
+  uint64_t start_ns;
+  uint64_t elapsed_ns;
+  uint32_t num_channels;
+  uint32_t num_samples;
+  uint32_t seconds;
+  uint32_t position;
+  uint32_t size;
+  uint32_t i;
+  uint32_t c;
+  int is_timing;
+  int option;
+
+  ecg_synth_params_init(&params);
+  seconds = 60;
+  num_channels = 1;
+  is_timing = 0;
+
+  while (-1 != (option = getopt(argc, argv, "n:c:ts:f:r:v:b:a:w:m:l:e:x:p:")))
+  {
+    switch (option)
+    {
+      case 'n': seconds = strtoul(optarg, NULL, 10); break;
+      case 'c': num_channels = strtoul(optarg, NULL, 10); break;
+      case 't': is_timing = 1; break;
+      case 's': params.seed = strtoul(optarg, NULL, 10); break;
+      case 'f': params.frequency = strtoul(optarg, NULL, 10); break;
+      case 'r': params.heartrate = strtoul(optarg, NULL, 10); break;
+      case 'v': params.hrv = strtoul(optarg, NULL, 10); break;
+      case 'b': params.baseline = strtoul(optarg, NULL, 10); break;
+      case 'a': params.amplitude = strtoul(optarg, NULL, 10); break;
+      case 'w': params.wander = strtoul(optarg, NULL, 10); break;
+      case 'm': params.mains = strtoul(optarg, NULL, 10); break;
+      case 'l': params.mains_frequency = strtoul(optarg, NULL, 10); break;
+      case 'e': params.noise = strtoul(optarg, NULL, 10); break;
+      case 'x': params.artifact = strtoul(optarg, NULL, 10); break;
+      case 'p': params.artifacts_per_hour = strtoul(optarg, NULL, 10); break;
+      default:
+        PrintUsage(argv[0], &params);
+        return 1;
+    }
+  }
+
+  if (0 == num_channels)
+  {
+    PrintUsage(argv[0], &params);
+    return 1;
+  }
+
+  synths = malloc(num_channels * sizeof(ecg_synth_t));
+  blocks = malloc(num_channels * sizeof(uint16_t*));
+  for (c = 0; c < num_channels; ++c)
+  {
+    if (ecg_synth_init(&synths[c], &params))
+    {
+      fprintf(stderr, "%s: settings out of range\n", argv[0]);
+      return 1;
+    }
+    params.seed++;
+
+    // Timing needs no more than one block, which stays in the cache.
+    blocks[c] = is_timing ? block : malloc(BLOCK_SIZE * sizeof(uint16_t));
+  }
+
+  num_samples = seconds * params.frequency;
+  elapsed_ns = 0;
+
+  for (position = 0; position < num_samples; position += size)
+  {
+    size = (num_samples - position < BLOCK_SIZE) ? num_samples - position : BLOCK_SIZE;
+
+    start_ns = GetWallNs();
+    for (c = 0; c < num_channels; ++c)
+    {
+      ecg_synth_generate(&synths[c], blocks[c], size);
+    }
+    elapsed_ns += GetWallNs() - start_ns;
+
+    if (!is_timing)
+    {
+      for (i = 0; i < size; ++i)
+      {
+        for (c = 0; c < num_channels; ++c)
+        {
+          printf((c + 1 < num_channels) ? "%u " : "%u\n", blocks[c][i]);
+        }
+      }
+    }
+  }
+
+  if (is_timing)
+  {
+    printf("%u channels, %u s: %.3f s, %.2f ns per sample, %.0f channels in real time\n",
+           num_channels, seconds, elapsed_ns * 1e-9,
+           (double)elapsed_ns / ((double)num_samples * num_channels),
+           elapsed_ns ? 1e9 * seconds * num_channels / elapsed_ns : 0.0);
+  }
+
+  if (!is_timing)
+  {
+    for (c = 0; c < num_channels; ++c)
+    {
+      free(blocks[c]);
+    }
+  }
+  free(blocks);
+  free(synths);
+
+  return 0;
+}
@@ -0,0 +1,328 @@
+#include <math.h>
+#include <stddef.h>
+#include "qrs.h"
+#include "ecg_synth.h"
+
+#define PI 3.14159265358979f
+
+/**
+  @brief A wave of the heartbeat: a Gaussian around a time from the R wave.
+  */
+typedef struct {
+  float height; // The height relative to the R wave.
+  float center; // The time of the peak from the R wave in seconds.
+  float width;  // The standard deviation in seconds.
+} Wave;
+
+/**
+  @brief The P, Q, R and S waves. The T wave moves with the RR interval.
+  */
+static const Wave kWaves[] = {
+  { 0.15f, -0.200f, 0.025f },
+  { -0.12f, -0.025f, 0.008f },
+  { 1.00f, 0.000f, 0.010f },
+  { -0.25f, 0.025f, 0.009f }
+};
+
+static const uint16_t kNumWaves = sizeof(kWaves) / sizeof(kWaves[0]);
+
+/**
+  @brief The height and width of the T wave.
+  */
+static const float kTWaveHeight = 0.30f;
+static const float kTWaveWidth = 0.045f;
+
+/**
+  @brief The time of the T wave from the R wave at an RR interval of 1 s.
+  @note It scales with the square root of the RR interval (Bazett).
+  */
+static const float kTWaveCenter = 0.25f;
+
+/**
+  @brief The time from the start of the template to the R wave in seconds.
+  */
+static const float kBeatLead = 0.30f;
+
+/**
+  @brief The frequency of the respiration that moves the baseline and
+         modulates the RR intervals.
+  */
+static const float kBreathFrequency = 0.25f;
+
+/**
+  @brief The time constant of the decay of a motion artifact in seconds.
+  */
+static const float kArtifactTimeConstant = 0.3f;
+
+/**
+  @brief The share of the RR variance that follows the respiration.
+  */
+static const float kRespiratoryShare = 0.25f;
+
+/**
+  @brief The number of samples between renormalizations of the phasors.
+  @note Must be a power of 2.
+  */
+static const uint32_t kPhasorNormalizePeriod = 1024;
+
+/**
+  @brief The slowest and fastest heart rates in beats per minute.
+  */
+static const uint16_t kMinHeartrate = 20;
+static const uint16_t kMaxHeartrate = 300;
+
+void ecg_synth_params_init(ecg_synth_params_t* params)
+{
+  params->seed = 1;
+  params->frequency = QRS_SAMPLING_FREQUENCY;
+  params->heartrate = 72;
+  params->hrv = 50;
+  params->baseline = 900;
+  params->amplitude = 220;
+  params->wander = 40;
+  params->mains = 10;
+  params->mains_frequency = 50;
+  params->noise = 5;
+  params->artifact = 200;
+  params->artifacts_per_hour = 30;
+}
+
+/**
+  @brief Return the next 32 random bits (xorshift32).
+  */
+static inline uint32_t NextRandom(ecg_synth_t* synth)
+{
+  uint32_t x;
+
+  x = synth->random;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  synth->random = x;
+
+  return x;
+}
+
+/**
+  @brief Return a random number in (0, 1).
+  */
+static float NextUniform(ecg_synth_t* synth)
+{
+  return ((NextRandom(synth) >> 8) + 0.5f) / 16777216.0f;
+}
+
+/**
+  @brief Return a random number of mean 0 and standard deviation 1.
+  @note The sum of the four bytes of a random word is close enough to a
+        Gaussian for noise and costs no more than one xorshift.
+  */
+static inline float NextNoise(ecg_synth_t* synth)
+{
+  uint32_t x;
+
+  x = NextRandom(synth);
+  x = (x & 0x00FF00FF) + ((x >> 8) & 0x00FF00FF);
+  x = (x & 0xFFFF) + (x >> 16);
+
+  return ((float)x - 510.0f) * (1.0f / 147.8f);
+}
+
+/**
+  @brief Return the samples until the heartbeat after the next one.
+  @note The RR interval is Gaussian around the mean, with a part in phase
+        with the respiration (respiratory sinus arrhythmia).
+  */
+static uint32_t NextInterval(ecg_synth_t* synth)
+{
+  const ecg_synth_params_t* params;
+  float interval;
+  float gaussian;
+  float breath;
+  uint32_t shortest;
+
+  params = &synth->params;
+
+  // Box-Muller once per heartbeat.
+  gaussian = sqrtf(-2.0f * logf(NextUniform(synth))) * cosf(2.0f * PI * NextUniform(synth));
+  breath = synth->wander[1] * sqrtf(2.0f);
+
+  interval = 60.0f / params->heartrate +
+             params->hrv * 0.001f * (sqrtf(kRespiratoryShare) * breath +
+                                     sqrtf(1.0f - kRespiratoryShare) * gaussian);
+
+  // The templates of at most ECG_SYNTH_MAX_ACTIVE_BEATS heartbeats overlap.
+  shortest = (synth->beat_size + ECG_SYNTH_MAX_ACTIVE_BEATS - 1) / ECG_SYNTH_MAX_ACTIVE_BEATS;
+  interval *= params->frequency;
+
+  return (interval > shortest) ? (uint32_t)(interval + 0.5f) : shortest;
+}
+
+/**
+  @brief Set a phasor to a phase and its rotation to a frequency.
+  */
+static void StartPhasor(float* phasor, float* step, float phase, float frequency,
+                        uint16_t sampling_frequency)
+{
+  phasor[0] = cosf(2.0f * PI * phase);
+  phasor[1] = sinf(2.0f * PI * phase);
+  step[0] = cosf(2.0f * PI * frequency / sampling_frequency);
+  step[1] = sinf(2.0f * PI * frequency / sampling_frequency);
+}
+
+/**
+  @brief Rotate a phasor by its step.
+  */
+static inline void RotatePhasor(float* phasor, const float* step)
+{
+  float x;
+
+  x = phasor[0] * step[0] - phasor[1] * step[1];
+  phasor[1] = phasor[0] * step[1] + phasor[1] * step[0];
+  phasor[0] = x;
+}
+
+/**
+  @brief Scale a phasor back to length 1, undoing the rounding errors of
+         the rotations.
+  */
+static void NormalizePhasor(float* phasor)
+{
+  float scale;
+
+  scale = 1.0f / sqrtf(phasor[0] * phasor[0] + phasor[1] * phasor[1]);
+  phasor[0] *= scale;
+  phasor[1] *= scale;
+}
+
+int ecg_synth_init(ecg_synth_t* synth, const ecg_synth_params_t* params)
+{
+  float t_center;
+  float duration;
+  float t;
+  float value;
+  uint16_t i;
+  uint16_t w;
+
+  if (NULL == params)
+  {
+    ecg_synth_params_init(&synth->params);
+  }
+  else
+  {
+    synth->params = *params;
+  }
+  params = &synth->params;
+
+  if (0 == params->frequency || params->heartrate < kMinHeartrate ||
+      params->heartrate > kMaxHeartrate)
+  {
+    return -1;
+  }
+
+  // The template ends three widths after the T wave.
+  t_center = kTWaveCenter * sqrtf(60.0f / params->heartrate);
+  duration = kBeatLead + t_center + 3 * kTWaveWidth;
+  if (duration * params->frequency > ECG_SYNTH_TEMPLATE_MAX_SIZE)
+  {
+    return -1;
+  }
+
+  synth->beat_size = (uint16_t)(duration * params->frequency);
+  for (i = 0; i < synth->beat_size; ++i)
+  {
+    t = (float)i / params->frequency - kBeatLead;
+    value = kTWaveHeight * expf(-0.5f * (t - t_center) * (t - t_center) /
+                                (kTWaveWidth * kTWaveWidth));
+    for (w = 0; w < kNumWaves; ++w)
+    {
+      value += kWaves[w].height * expf(-0.5f * (t - kWaves[w].center) * (t - kWaves[w].center) /
+                                       (kWaves[w].width * kWaves[w].width));
+    }
+    synth->beat[i] = (int16_t)lrintf(value * params->amplitude);
+  }
+
+  // xorshift32 must not start at 0.
+  synth->random = params->seed * 2654435761U ^ 0x9E3779B9U;
+  if (0 == synth->random)
+  {
+    synth->random = 1;
+  }
+
+  // Channels of different seeds start at different phases.
+  StartPhasor(synth->wander, synth->wander_step, NextUniform(synth), kBreathFrequency,
+              params->frequency);
+  StartPhasor(synth->mains, synth->mains_step, NextUniform(synth), params->mains_frequency,
+              params->frequency);
+
+  synth->num_active = 0;
+  synth->until_beat = (uint32_t)(NextUniform(synth) * NextInterval(synth));
+
+  synth->artifact = 0;
+  synth->artifact_decay = expf(-1.0f / (kArtifactTimeConstant * params->frequency));
+  synth->artifact_chance = (uint32_t)(4294967296.0 * params->artifacts_per_hour /
+                                      (3600.0 * params->frequency));
+
+  return 0;
+}
+
+void ecg_synth_generate(ecg_synth_t* synth, uint16_t* data, uint32_t size)
+{
+  const ecg_synth_params_t* params;
+  float value;
+  uint32_t i;
+  uint16_t k;
+
+  params = &synth->params;
+
+  for (i = 0; i < size; ++i)
+  {
+    if (0 == synth->until_beat--)
+    {
+      synth->active[synth->num_active++] = 0;
+      synth->until_beat = NextInterval(synth) - 1;
+    }
+
+    value = params->baseline;
+
+    // Draw the heartbeats, dropping those that have ended.
+    for (k = 0; k < synth->num_active; )
+    {
+      value += synth->beat[synth->active[k]];
+      if (++synth->active[k] == synth->beat_size)
+      {
+        synth->active[k] = synth->active[--synth->num_active];
+      }
+      else
+      {
+        ++k;
+      }
+    }
+
+    // The rounding errors of the rotations change the amplitude, so the
+    // phasors are scaled back every kPhasorNormalizePeriod samples.
+    if (0 == (i & (kPhasorNormalizePeriod - 1)))
+    {
+      NormalizePhasor(synth->wander);
+      NormalizePhasor(synth->mains);
+    }
+
+    value += params->wander * synth->wander[1] + params->mains * synth->mains[1] +
+             params->noise * NextNoise(synth);
+    RotatePhasor(synth->wander, synth->wander_step);
+    RotatePhasor(synth->mains, synth->mains_step);
+
+    if (synth->artifact_chance)
+    {
+      if (NextRandom(synth) < synth->artifact_chance)
+      {
+        synth->artifact += params->artifact * (2.0f * NextUniform(synth) - 1.0f);
+      }
+      value += synth->artifact;
+      synth->artifact *= synth->artifact_decay;
+    }
+
+    // Round to the 12-bit ADC range.
+    value += 0.5f;
+    data[i] = (value < 0) ? 0 : (value > 4095) ? 4095 : (uint16_t)value;
+  }
+}
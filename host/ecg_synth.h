@@ -0,0 +1,91 @@
+#ifndef ECG_SYNTH_H
+#define ECG_SYNTH_H
+
+#include <stdint.h>
+
+// Deterministic generator of synthetic ECG for load tests of the host tools.
+// Each heartbeat is a P wave, a QRS complex and a T wave (a sum of Gaussians)
+// tabulated once at the sampling frequency, started at RR intervals drawn
+// around the heart rate with the requested variability and a respiratory
+// modulation. Baseline wander, mains interference, white noise and motion
+// artifacts (steps that decay over a few hundred milliseconds) are added,
+// and the sum is rounded to the unsigned 12-bit ADC samples that
+// store_adc_value records. The same parameters and seed always give the
+// same samples, and a generator only needs a few additions per sample, so
+// thousands of channels can be generated faster than real time.
+
+/**
+  @brief The most samples of the heartbeat template (1 s at 1000 Hz).
+  */
+#define ECG_SYNTH_TEMPLATE_MAX_SIZE 1000
+
+/**
+  @brief The most heartbeats whose templates overlap at a time.
+  */
+#define ECG_SYNTH_MAX_ACTIVE_BEATS 4
+
+/**
+  @brief The settings of the generator.
+  @note Amplitudes are in ADC counts.
+  */
+typedef struct {
+  uint32_t seed;               // The seed of the random numbers.
+  uint16_t frequency;          // The sampling frequency in Hz (at most 1000).
+  uint16_t heartrate;          // The mean heart rate in beats per minute.
+  uint16_t hrv;                // The standard deviation of the RR intervals in ms.
+  uint16_t baseline;           // The sample value of 0 mV.
+  uint16_t amplitude;          // The height of the R wave.
+  uint16_t wander;             // The amplitude of the baseline wander.
+  uint16_t mains;              // The amplitude of the mains interference.
+  uint16_t mains_frequency;    // The mains frequency in Hz (50 or 60).
+  uint16_t noise;              // The standard deviation of the white noise.
+  uint16_t artifact;           // The largest step of a motion artifact.
+  uint16_t artifacts_per_hour; // The mean rate of the motion artifacts.
+} ecg_synth_params_t;
+
+/**
+  @brief The state of one generated channel.
+  */
+typedef struct {
+  ecg_synth_params_t params;  // The settings.
+  int16_t beat[ECG_SYNTH_TEMPLATE_MAX_SIZE]; // The heartbeat template.
+  uint16_t beat_size;         // The number of samples of beat.
+  uint16_t active[ECG_SYNTH_MAX_ACTIVE_BEATS]; // The next index in beat of each
+                                               // heartbeat being drawn.
+  uint16_t num_active;        // The number of entries of active.
+  uint32_t until_beat;        // The samples until the next heartbeat starts.
+  uint32_t random;            // The state of the random numbers.
+  float wander[2];            // The rotating phasor of the baseline wander.
+  float wander_step[2];       // The rotation of the baseline wander per sample.
+  float mains[2];             // The rotating phasor of the mains interference.
+  float mains_step[2];        // The rotation of the mains interference per sample.
+  float artifact;             // The offset left by the motion artifacts.
+  float artifact_decay;       // The decay of the offset per sample.
+  uint32_t artifact_chance;   // The chance of an artifact per sample, scaled by 2^32.
+} ecg_synth_t;
+
+/**
+  @brief Set the default settings: QRS_SAMPLING_FREQUENCY, 72 beats per
+         minute, 50 ms of variability and the levels of the TEST_SAMPLE
+         capture.
+  @param params  The settings.
+  */
+void ecg_synth_params_init(ecg_synth_params_t* params);
+
+/**
+  @brief Start a channel.
+  @param synth   The channel.
+  @param params  The settings, or NULL for the defaults.
+  @return 0 on success, otherwise -1 if the settings are out of range.
+  */
+int ecg_synth_init(ecg_synth_t* synth, const ecg_synth_params_t* params);
+
+/**
+  @brief Generate the next samples of a channel.
+  @param synth  The channel.
+  @param data   Set to the samples (0 to 4095).
+  @param size   The number of samples.
+  */
+void ecg_synth_generate(ecg_synth_t* synth, uint16_t* data, uint32_t size);
+
+#endif // ECG_SYNTH_H
@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "hal.h"
+
+/**
+  @brief The firmware entry point from main.c, which is built with
+         -Dmain=hal_sim_firmware_main so the simulator provides main.
+  */
+int hal_sim_firmware_main(void);
+
+// Interrupt service routines from main.c.
+void refresh_display(void);
+void start_adc_conversion(void);
+void start_qrs_detector(void);
+void store_adc_value(void);
+
+/**
+  @brief Virtual ticks per second.
+  @note All timers are clocked from ACLK (32768 Hz). The detector and display
+        timers divide it by 8.
+  */
+static const uint32_t kTicksPerSecond = 32768;
+
+/**
+  @brief A virtual timer in up mode with an interrupt on CCR0.
+  */
+typedef struct {
+  const char* name;   // Name used in the summary.
+  void (*isr)(void);  // Interrupt service routine called on CCR0.
+  uint32_t period;    // Ticks between interrupts or 0 if disabled.
+  uint64_t next;      // Virtual tick of the next interrupt.
+  uint32_t count;     // Number of interrupts raised.
+} sim_timer_t;
+
+static sim_timer_t detector_timer = { "detector", start_qrs_detector, 0, 0, 0 };
+static sim_timer_t sampler_timer  = { "sampler",  start_adc_conversion, 0, 0, 0 };
+static sim_timer_t display_timer  = { "display",  refresh_display, 0, 0, 0 };
+
+static sim_timer_t* const timers[] = {
+  &detector_timer,
+  &sampler_timer,
+  &display_timer
+};
+
+static const uint16_t kNumTimers = sizeof(timers) / sizeof(timers[0]);
+
+// The ECG samples replayed through the virtual ADC.
+static uint16_t* samples = NULL;
+static uint32_t num_samples = 0;
+static uint32_t sample_index = 0;
+
+// The state of the virtual ADC.
+static uint16_t adc_value = 0;
+static uint16_t is_adc_pending = 0;
+static uint16_t is_finished = 0;
+
+// The file the binary trace is written to or NULL.
+static FILE* trace_file = NULL;
+
+// The state of the virtual CPU.
+static uint64_t now = 0;
+static uint16_t is_awake = 0;
+
+// Profiling counters.
+static uint32_t num_adc_interrupts = 0;
+static uint32_t num_wakeups = 0;
+static uint32_t num_display_updates = 0;
+static uint64_t active_ns = 0;
+static uint64_t active_start_ns = 0;
+static uint64_t start_ns = 0;
+
+/**
+  @brief Return a monotonic wall clock time in nanoseconds.
+  */
+static uint64_t GetWallNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+  @brief Return the virtual time in seconds.
+  */
+static double GetVirtualSeconds(void)
+{
+  return (double)now / kTicksPerSecond;
+}
+
+/**
+  @brief Free the samples read by LoadSamples.
+  */
+static void FreeSamples(void)
+{
+  free(samples);
+  samples = NULL;
+}
+
+/**
+  @brief Read an ECG file of unsigned samples separated by whitespace or commas.
+  @param  path    The path of the ECG file.
+  @param  repeat  The number of times to replay the file.
+  @return 0 on success, otherwise -1.
+  */
+static int LoadSamples(const char* path, uint32_t repeat)
+{
+  FILE* file;
+  uint16_t* resized;
+  uint32_t capacity;
+  uint32_t length;
+  uint32_t value;
+  uint16_t has_digit;
+  uint32_t i;
+  int c;
+
+  file = fopen(path, "r");
+  if (NULL == file)
+  {
+    perror(path);
+    return -1;
+  }
+
+  capacity = 4096;
+  length = 0;
+  samples = malloc(capacity * sizeof(uint16_t));
+  if (NULL == samples)
+  {
+    fprintf(stderr, "%s: out of memory\n", path);
+    fclose(file);
+    return -1;
+  }
+
+  value = 0;
+  has_digit = 0;
+
+  do
+  {
+    c = fgetc(file);
+
+    if (c >= '0' && c <= '9')
+    {
+      value = value * 10 + (c - '0');
+      has_digit = 1;
+    }
+    else if (has_digit)
+    {
+      if (length == capacity)
+      {
+        capacity *= 2;
+        resized = realloc(samples, (uint64_t)capacity * sizeof(uint16_t));
+        if (NULL == resized)
+        {
+          fprintf(stderr, "%s: out of memory\n", path);
+          fclose(file);
+          FreeSamples();
+          return -1;
+        }
+        samples = resized;
+      }
+
+      samples[length++] = (uint16_t)value;
+      value = 0;
+      has_digit = 0;
+    }
+  } while (EOF != c);
+
+  fclose(file);
+
+  if (0 == length)
+  {
+    fprintf(stderr, "%s: no samples\n", path);
+    FreeSamples();
+    return -1;
+  }
+
+  // The replay is counted in 32 bits.
+  if (repeat > UINT32_MAX / length)
+  {
+    fprintf(stderr, "%s: %u samples cannot be repeated %u times\n", path, length, repeat);
+    FreeSamples();
+    return -1;
+  }
+
+  resized = realloc(samples, (uint64_t)length * repeat * sizeof(uint16_t));
+  if (NULL == resized)
+  {
+    fprintf(stderr, "%s: out of memory\n", path);
+    FreeSamples();
+    return -1;
+  }
+  samples = resized;
+
+  for (i = length; i < length * repeat; ++i)
+  {
+    samples[i] = samples[i - length];
+  }
+  num_samples = length * repeat;
+
+  return 0;
+}
+
+/**
+  @brief Print the profiling summary and end the simulation.
+  */
+static void Finish(void)
+{
+  uint64_t wall_ns;
+  double virtual_seconds;
+  uint16_t i;
+
+  wall_ns = GetWallNs() - start_ns;
+  virtual_seconds = GetVirtualSeconds();
+
+  fprintf(stderr, "samples:          %u\n", sample_index);
+  fprintf(stderr, "virtual time:     %.3f s\n", virtual_seconds);
+  fprintf(stderr, "wall time:        %.3f ms (%.0fx real time)\n",
+          wall_ns / 1e6, wall_ns ? virtual_seconds * 1e9 / wall_ns : 0.0);
+  fprintf(stderr, "wakeups:          %u\n", num_wakeups);
+  fprintf(stderr, "active time:      %.3f ms (%.3f us per wakeup)\n",
+          active_ns / 1e6, num_wakeups ? active_ns / 1e3 / num_wakeups : 0.0);
+  fprintf(stderr, "display updates:  %u\n", num_display_updates);
+
+  for (i = 0; i < kNumTimers; ++i)
+  {
+    fprintf(stderr, "%s interrupts: %u\n", timers[i]->name, timers[i]->count);
+  }
+  fprintf(stderr, "adc interrupts:   %u\n", num_adc_interrupts);
+
+  if (NULL != trace_file)
+  {
+    fclose(trace_file);
+  }
+
+  FreeSamples();
+  exit(0);
+}
+
+/**
+  @brief Initialize a virtual timer to interrupt every CCR0 + 1 ticks.
+  @note Up mode counts from zero to CCR0 inclusive.
+  */
+static void StartTimer(sim_timer_t* timer, uint32_t ccr0)
+{
+  timer->period = ccr0 + 1;
+  timer->next = now + timer->period;
+}
+
+uint16_t hal_read_adc(void)
+{
+  return adc_value;
+}
+
+void hal_start_adc_conversion(void)
+{
+  if (sample_index < num_samples)
+  {
+    adc_value = samples[sample_index++];
+    is_adc_pending = 1;
+  }
+  else
+  {
+    is_finished = 1;
+  }
+}
+
+void hal_toggle_display(void)
+{
+}
+
+void hal_enable_interrupts(void)
+{
+}
+
+void hal_enter_low_power_mode(void)
+{
+  sim_timer_t* timer;
+  uint16_t i;
+
+  active_ns += GetWallNs() - active_start_ns;
+  is_awake = 0;
+
+  // Advance virtual time from one interrupt to the next until one of the
+  // interrupt service routines wakes the CPU.
+  while (!is_awake)
+  {
+    if (is_finished)
+    {
+      Finish();
+    }
+
+    timer = NULL;
+    for (i = 0; i < kNumTimers; ++i)
+    {
+      if (timers[i]->period && (NULL == timer || timers[i]->next < timer->next))
+      {
+        timer = timers[i];
+      }
+    }
+
+    // Nothing is left that can wake the CPU.
+    if (NULL == timer)
+    {
+      Finish();
+    }
+
+    now = timer->next;
+    timer->next += timer->period;
+    timer->count++;
+    timer->isr();
+
+    // The conversion is treated as completing immediately.
+    if (is_adc_pending)
+    {
+      is_adc_pending = 0;
+      num_adc_interrupts++;
+      store_adc_value();
+    }
+  }
+
+  num_wakeups++;
+  active_start_ns = GetWallNs();
+}
+
+void hal_exit_low_power_mode_on_exit(void)
+{
+  is_awake = 1;
+}
+
+void hal_init_board(void)
+{
+}
+
+void hal_init_adc(void)
+{
+}
+
+void hal_init_detector_timer(uint16_t period)
+{
+  StartTimer(&detector_timer, ((kTicksPerSecond >> 3) * period) << 3);
+}
+
+void hal_init_display_driver(void)
+{
+}
+
+void hal_init_display_timer(uint16_t frequency)
+{
+  StartTimer(&display_timer, ((kTicksPerSecond >> 3) / frequency) << 3);
+}
+
+void hal_init_sampler_timer(uint16_t frequency)
+{
+  StartTimer(&sampler_timer, (kTicksPerSecond + frequency / 2) / frequency - 1);
+}
+
+void hal_init_cycle_counter(void)
+{
+}
+
+uint32_t hal_read_cycle_counter(void)
+{
+  return (uint32_t)GetWallNs();
+}
+
+void hal_init_trace(void)
+{
+}
+
+void hal_trace_write(const void* data, uint16_t size)
+{
+  // The frames are little-endian like the MSP430.
+  if (NULL != trace_file)
+  {
+    fwrite(data, 1, size, trace_file);
+  }
+}
+
+void hal_set_display_segments(uint8_t first, uint8_t second, uint8_t third)
+{
+  static const uint8_t seven_seg_to_digit[128] = {
+    [0x3F] = 0, [0x0C] = 1, [0x5B] = 2, [0x5E] = 3, [0x6C] = 4,
+    [0x76] = 5, [0x77] = 6, [0x1C] = 7, [0x7F] = 8, [0x7E] = 9
+  };
+  uint16_t value;
+
+  value = seven_seg_to_digit[first & 0x7F] +
+          seven_seg_to_digit[second & 0x7F] * 10;
+
+  // The third digit is blank, one or the error segment.
+  if (0x05 == third)
+  {
+    value += 100;
+  }
+
+  num_display_updates++;
+
+  if (0x04 == third)
+  {
+    printf("%.3f,E%02u\n", GetVirtualSeconds(), value);
+  }
+  else
+  {
+    printf("%.3f,%u\n", GetVirtualSeconds(), value);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t repeat;
+
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s <ecg_file> [repeat] [trace_file]\n", argv[0]);
+    return 1;
+  }
+
+  repeat = (argc > 2) ? strtoul(argv[2], NULL, 10) : 1;
+  if (0 == repeat)
+  {
+    repeat = 1;
+  }
+
+  if (LoadSamples(argv[1], repeat))
+  {
+    return 1;
+  }
+
+  if (argc > 3)
+  {
+    trace_file = fopen(argv[3], "wb");
+    if (NULL == trace_file)
+    {
+      perror(argv[3]);
+      return 1;
+    }
+  }
+
+  start_ns = GetWallNs();
+  active_start_ns = start_ns;
+
+  // The firmware never returns. The simulation ends in Finish once the
+  // ECG file has been replayed.
+  return hal_sim_firmware_main();
+}
@@ -0,0 +1,666 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "qrs.h"
+#include "qrs_parallel.h"
+#include "wfdb.h"
+
+// The batch window of the firmware (SAMPLE_LEN in main.h).
+#define WINDOW_SIZE 1250
+
+// The seconds between heart rate updates of the firmware
+// (QRS_DETECTING_PERIOD in main.h).
+#define DISPLAY_PERIOD 2
+
+/**
+  @brief The largest distance between a heartbeat and its annotation.
+  @note 150 ms, as in ANSI/AAMI EC57.
+  */
+static const uint32_t kMatchWindow = QRS_SAMPLING_FREQUENCY * 150 / 1000;
+
+/**
+  @brief The delay from the QRS to its streaming detection.
+  @note The threshold is crossed as the QRS enters the low pass window, and
+        the high pass output lags the raw signal by half its window.
+  */
+static const uint32_t kStreamDelay = QRS_HIGH_PASS_WINDOW_SIZE / 2;
+
+/**
+  @brief The lead of a batch detection over the streaming detection.
+  @note The batch low pass output of sample n is the streaming output of
+        sample n + M - 1.
+  */
+static const uint32_t kBatchLead = QRS_LOW_PASS_WINDOW_SIZE - 1;
+
+/**
+  @brief Annotation codes that are heartbeats (isqrs in the WFDB library).
+  */
+static const uint8_t kIsBeat[64] = {
+  [1] = 1, [2] = 1, [3] = 1, [4] = 1, [5] = 1, [6] = 1, [7] = 1, [8] = 1,
+  [9] = 1, [10] = 1, [11] = 1, [12] = 1, [13] = 1, [25] = 1, [30] = 1,
+  [34] = 1, [35] = 1, [38] = 1, [41] = 1
+};
+
+// Annotation codes with special meanings in MIT format.
+#define ANNOTATION_SKIP 59
+#define ANNOTATION_NUM 60
+#define ANNOTATION_SUB 61
+#define ANNOTATION_CHN 62
+#define ANNOTATION_AUX 63
+
+/**
+  @brief The stages of the detector that are timed.
+  */
+typedef enum {
+  kStageHighPass,
+  kStageLowPass,
+  kStageThreshold,
+  kStageFused,
+  kStageStream,
+  kNumStages
+} Stage;
+
+static const char* const kStageNames[kNumStages] = {
+  "high_pass", "low_pass", "threshold", "fused", "stream"
+};
+
+/**
+  @brief Heartbeats matched against the annotations.
+  */
+typedef struct {
+  uint32_t true_positives;
+  uint32_t false_positives;
+  uint32_t false_negatives;
+} Match;
+
+/**
+  @brief The results of one record, or the sum over all records.
+  */
+typedef struct {
+  uint64_t num_samples;
+  uint64_t num_annotations;
+  Match stream;
+  Match batch;
+  double stream_hr_error_sum;   // The sum of the absolute heart rate errors.
+  double batch_hr_error_sum;
+  uint32_t num_hr_updates;      // The number of heart rate updates compared.
+  uint64_t stage_ns[kNumStages];      // The time spent in each stage.
+  uint64_t stage_samples[kNumStages]; // The samples timed in each stage.
+} Result;
+
+/**
+  @brief Return a monotonic wall clock time in nanoseconds.
+  */
+static uint64_t GetWallNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+  @brief Read the heartbeats of a WFDB annotation file in MIT format.
+  @param  path         The path of the annotation file.
+  @param  num_beats    Set to the number of heartbeats.
+  @return The sample index of each heartbeat, or NULL after printing the
+          reason.
+  @note Each annotation is a 16-bit little-endian word of a 6-bit code and
+        a 10-bit time since the previous annotation. Longer times come in a
+        SKIP, and the other special codes do not move the time.
+  */
+static uint32_t* ReadAnnotations(const char* path, uint32_t* num_beats)
+{
+  FILE* file;
+  uint8_t* data;
+  uint32_t* beats;
+  uint32_t* resized;
+  long length;
+  uint32_t capacity;
+  uint32_t size;
+  uint32_t position;
+  uint32_t time;
+  uint16_t word;
+  uint16_t code;
+  uint16_t interval;
+
+  file = fopen(path, "rb");
+  if (NULL == file)
+  {
+    perror(path);
+    return NULL;
+  }
+
+  fseek(file, 0, SEEK_END);
+  length = ftell(file);
+  if (length < 0 || length >= UINT32_MAX || fseek(file, 0, SEEK_SET))
+  {
+    fprintf(stderr, "%s: cannot find the size\n", path);
+    fclose(file);
+    return NULL;
+  }
+
+  size = length;
+  data = malloc(size + 1);
+  if (NULL == data)
+  {
+    fprintf(stderr, "%s: out of memory\n", path);
+    fclose(file);
+    return NULL;
+  }
+  size = fread(data, 1, size, file);
+  fclose(file);
+
+  capacity = 4096;
+  beats = malloc(capacity * sizeof(uint32_t));
+  if (NULL == beats)
+  {
+    fprintf(stderr, "%s: out of memory\n", path);
+    free(data);
+    return NULL;
+  }
+  *num_beats = 0;
+  time = 0;
+
+  for (position = 0; position + 2 <= size; )
+  {
+    word = data[position] | (data[position + 1] << 8);
+    position += 2;
+    code = word >> 10;
+    interval = word & 0x3FF;
+
+    if (0 == word)
+    {
+      break;
+    }
+
+    switch (code)
+    {
+      case ANNOTATION_SKIP:
+        // A 32-bit time, the high word first.
+        if (position + 4 <= size)
+        {
+          time += ((uint32_t)(data[position] | (data[position + 1] << 8)) << 16) |
+                  (data[position + 2] | (data[position + 3] << 8));
+        }
+        position += 4;
+        break;
+      case ANNOTATION_NUM:
+      case ANNOTATION_SUB:
+      case ANNOTATION_CHN:
+        break;
+      case ANNOTATION_AUX:
+        position += (interval + 1) & ~1U;
+        break;
+      default:
+        time += interval;
+        if (kIsBeat[code])
+        {
+          if (*num_beats == capacity)
+          {
+            capacity *= 2;
+            resized = realloc(beats, (uint64_t)capacity * sizeof(uint32_t));
+            if (NULL == resized)
+            {
+              fprintf(stderr, "%s: out of memory\n", path);
+              free(data);
+              free(beats);
+              return NULL;
+            }
+            beats = resized;
+          }
+          beats[(*num_beats)++] = time;
+        }
+        break;
+    }
+  }
+
+  free(data);
+
+  return beats;
+}
+
+/**
+  @brief Match heartbeats to the annotations from a sample on.
+  @param  beats            The sample index of each heartbeat, in order.
+  @param  num_beats        The number of heartbeats.
+  @param  annotations      The annotated heartbeats, in order.
+  @param  num_annotations  The number of annotated heartbeats.
+  @param  start            The first sample that is scored.
+  @param  match            Incremented by the matches.
+  @note Each annotation matches at most one heartbeat within kMatchWindow.
+  */
+static void MatchBeats(const uint32_t* beats, uint32_t num_beats,
+                       const uint32_t* annotations, uint32_t num_annotations,
+                       uint32_t start, Match* match)
+{
+  uint32_t i;
+  uint32_t j;
+
+  for (i = 0; i < num_beats && beats[i] < start; ++i)
+  {
+  }
+  for (j = 0; j < num_annotations && annotations[j] < start; ++j)
+  {
+  }
+
+  while (i < num_beats && j < num_annotations)
+  {
+    if (beats[i] + kMatchWindow < annotations[j])
+    {
+      match->false_positives++;
+      i++;
+    }
+    else if (beats[i] > annotations[j] + kMatchWindow)
+    {
+      match->false_negatives++;
+      j++;
+    }
+    else
+    {
+      match->true_positives++;
+      i++;
+      j++;
+    }
+  }
+
+  match->false_positives += num_beats - i;
+  match->false_negatives += num_annotations - j;
+}
+
+/**
+  @brief Return the mean heart rate of the annotated intervals in a window.
+  @return The heart rate in beats per minute, or 0 without an interval.
+  */
+static double GetAnnotatedHeartrate(const uint32_t* annotations, uint32_t num_annotations,
+                                    uint32_t start, uint32_t end)
+{
+  double sum;
+  uint32_t count;
+  uint32_t j;
+
+  sum = 0;
+  count = 0;
+  for (j = 1; j < num_annotations && annotations[j] < end; ++j)
+  {
+    if (annotations[j - 1] >= start)
+    {
+      sum += 60.0 * QRS_SAMPLING_FREQUENCY / (annotations[j] - annotations[j - 1]);
+      count++;
+    }
+  }
+
+  return count ? sum / count : 0;
+}
+
+/**
+  @brief Run the streaming detector over a record.
+  @return The number of heartbeats, aligned to the QRS.
+  @note The heart rate shown every DISPLAY_PERIOD is compared with the
+        annotated heart rate of the window before it.
+  */
+static uint32_t RunStream(const uint16_t* data, uint32_t size, uint32_t* beats,
+                          const uint32_t* annotations, uint32_t num_annotations,
+                          Result* result)
+{
+  qrs_stream_t stream;
+  uint64_t start_ns;
+  uint32_t num_beats;
+  uint32_t end;
+  uint32_t n;
+  double annotated;
+
+  qrs_stream_init(&stream, NULL);
+  num_beats = 0;
+
+  for (end = DISPLAY_PERIOD * QRS_SAMPLING_FREQUENCY, n = 0; n < size;
+       end += DISPLAY_PERIOD * QRS_SAMPLING_FREQUENCY)
+  {
+    if (end > size)
+    {
+      end = size;
+    }
+
+    start_ns = GetWallNs();
+    for (; n < end; ++n)
+    {
+      if (qrs_stream_push(&stream, data[n]))
+      {
+        beats[num_beats++] = n - kStreamDelay;
+      }
+    }
+    result->stage_ns[kStageStream] += GetWallNs() - start_ns;
+    result->stage_samples[kStageStream] = n;
+
+    // The heart rate is only shown at the end of a whole period.
+    if (end >= WINDOW_SIZE && 0 == end % (DISPLAY_PERIOD * QRS_SAMPLING_FREQUENCY))
+    {
+      annotated = GetAnnotatedHeartrate(annotations, num_annotations, end - WINDOW_SIZE, end);
+      if (annotated > 0)
+      {
+        result->stream_hr_error_sum += fabs(qrs_stream_get_heartrate(&stream) - annotated);
+      }
+    }
+  }
+
+  return num_beats;
+}
+
+/**
+  @brief Run the batch detector of the firmware every DISPLAY_PERIOD and
+         compare its heart rate with the annotated heart rate.
+  */
+static void RunBatchHeartrate(const uint16_t* data, uint32_t size,
+                              const uint32_t* annotations, uint32_t num_annotations,
+                              Result* result)
+{
+  qrs_ring_view_t view;
+  uint32_t end;
+  uint16_t heartrate;
+  double annotated;
+
+  view.packed = NULL;
+  view.capacity = WINDOW_SIZE;
+  view.start = 0;
+
+  for (end = DISPLAY_PERIOD * QRS_SAMPLING_FREQUENCY; end <= size;
+       end += DISPLAY_PERIOD * QRS_SAMPLING_FREQUENCY)
+  {
+    if (end < WINDOW_SIZE)
+    {
+      continue;
+    }
+
+    annotated = GetAnnotatedHeartrate(annotations, num_annotations, end - WINDOW_SIZE, end);
+    if (annotated > 0)
+    {
+      view.base = (uint16_t*)data + end - WINDOW_SIZE;
+      heartrate = qrs_get_heartrate_ring(&view, NULL, NULL, WINDOW_SIZE);
+      result->batch_hr_error_sum += fabs(heartrate - annotated);
+      result->num_hr_updates++;
+    }
+  }
+}
+
+/**
+  @brief Time each stage of the batch detector over the record, one
+         WINDOW_SIZE window at a time.
+  */
+static void TimeBatchStages(const uint16_t* data, uint32_t size, Result* result)
+{
+  static uint16_t data_hp[WINDOW_SIZE];
+  static uint16_t data_lp[WINDOW_SIZE];
+  qrs_ring_view_t view;
+  uint64_t times[kNumStages + 1];
+  uint32_t start;
+  uint16_t stage;
+
+  view.packed = NULL;
+  view.capacity = WINDOW_SIZE;
+  view.start = 0;
+
+  for (start = 0; start + WINDOW_SIZE <= size; start += WINDOW_SIZE)
+  {
+    view.base = (uint16_t*)data + start;
+
+    times[kStageHighPass] = GetWallNs();
+    qrs_filter_high_pass(view.base, data_hp, WINDOW_SIZE);
+    times[kStageLowPass] = GetWallNs();
+    qrs_filter_low_pass(data_hp, data_lp, WINDOW_SIZE);
+    times[kStageThreshold] = GetWallNs();
+    qrs_get_heartrate(data_lp, NULL, NULL, WINDOW_SIZE);
+    times[kStageFused] = GetWallNs();
+    qrs_get_heartrate_ring(&view, NULL, NULL, WINDOW_SIZE);
+    times[kStageStream] = GetWallNs();
+
+    for (stage = kStageHighPass; stage < kStageStream; ++stage)
+    {
+      result->stage_ns[stage] += times[stage + 1] - times[stage];
+      result->stage_samples[stage] += WINDOW_SIZE;
+    }
+  }
+}
+
+/**
+  @brief Add the results of a record to the total.
+  */
+static void AddResult(Result* total, const Result* result)
+{
+  uint16_t stage;
+
+  total->num_samples += result->num_samples;
+  total->num_annotations += result->num_annotations;
+  total->stream.true_positives += result->stream.true_positives;
+  total->stream.false_positives += result->stream.false_positives;
+  total->stream.false_negatives += result->stream.false_negatives;
+  total->batch.true_positives += result->batch.true_positives;
+  total->batch.false_positives += result->batch.false_positives;
+  total->batch.false_negatives += result->batch.false_negatives;
+  total->stream_hr_error_sum += result->stream_hr_error_sum;
+  total->batch_hr_error_sum += result->batch_hr_error_sum;
+  total->num_hr_updates += result->num_hr_updates;
+
+  for (stage = 0; stage < kNumStages; ++stage)
+  {
+    total->stage_ns[stage] += result->stage_ns[stage];
+    total->stage_samples[stage] += result->stage_samples[stage];
+  }
+}
+
+/**
+  @brief Print the accuracy of a detector as record,metric,value lines.
+  */
+static void PrintMatch(const char* record, const char* detector, const Match* match,
+                       double hr_error_sum, uint32_t num_hr_updates)
+{
+  uint32_t tp;
+
+  tp = match->true_positives;
+  printf("%s,%s_tp,%u\n", record, detector, tp);
+  printf("%s,%s_fp,%u\n", record, detector, match->false_positives);
+  printf("%s,%s_fn,%u\n", record, detector, match->false_negatives);
+  printf("%s,%s_sensitivity,%.4f\n", record, detector,
+         tp ? (double)tp / (tp + match->false_negatives) : 0.0);
+  printf("%s,%s_positive_predictivity,%.4f\n", record, detector,
+         tp ? (double)tp / (tp + match->false_positives) : 0.0);
+  printf("%s,%s_hr_error_bpm,%.2f\n", record, detector,
+         num_hr_updates ? hr_error_sum / num_hr_updates : 0.0);
+}
+
+/**
+  @brief Print the results of a record or the total.
+  */
+static void PrintResult(const char* record, const Result* result)
+{
+  double ns_per_sample;
+  uint16_t stage;
+
+  printf("%s,samples,%llu\n", record, (unsigned long long)result->num_samples);
+  printf("%s,annotated_beats,%llu\n", record, (unsigned long long)result->num_annotations);
+  PrintMatch(record, "stream", &result->stream, result->stream_hr_error_sum,
+             result->num_hr_updates);
+  PrintMatch(record, "batch", &result->batch, result->batch_hr_error_sum,
+             result->num_hr_updates);
+
+  for (stage = 0; stage < kNumStages; ++stage)
+  {
+    ns_per_sample = result->stage_samples[stage] ?
+                    (double)result->stage_ns[stage] / result->stage_samples[stage] : 0;
+    printf("%s,%s_ns_per_sample,%.2f\n", record, kStageNames[stage], ns_per_sample);
+    printf("%s,%s_samples_per_second,%.0f\n", record, kStageNames[stage],
+           ns_per_sample > 0 ? 1e9 / ns_per_sample : 0.0);
+  }
+}
+
+/**
+  @brief Benchmark the detector on one record.
+  @return 0 on success, otherwise -1 after printing the reason.
+  */
+static int RunRecord(const char* header, const char* annotator, Result* result)
+{
+  char path[4096];
+  wfdb_record_t record;
+  uint16_t* data;
+  uint32_t* annotations;
+  uint32_t* beats;
+  uint32_t num_annotations;
+  int32_t num_batch_beats;
+  uint32_t num_beats;
+  uint32_t max_beats;
+  uint32_t start;
+  size_t length;
+
+  if (wfdb_open(&record, header, 0))
+  {
+    return -1;
+  }
+
+  if (QRS_SAMPLING_FREQUENCY != record.frequency)
+  {
+    fprintf(stderr, "%s: %u Hz, but built for %u Hz (-DQRS_SAMPLING_FREQUENCY)\n",
+            header, record.frequency, QRS_SAMPLING_FREQUENCY);
+    wfdb_close(&record);
+    return -1;
+  }
+
+  // The annotations are next to the header, with the annotator's extension.
+  length = strlen(header);
+  if (length > 4 && 0 == strcmp(header + length - 4, ".hea"))
+  {
+    length -= 4;
+  }
+  snprintf(path, sizeof(path), "%.*s.%s", (int)length, header, annotator);
+
+  annotations = ReadAnnotations(path, &num_annotations);
+  if (NULL == annotations)
+  {
+    wfdb_close(&record);
+    return -1;
+  }
+
+  data = malloc(record.num_samples * sizeof(uint16_t));
+  // Heartbeats are more than the shortest interval apart.
+  max_beats = record.num_samples / (QRS_SAMPLES_FROM_256_HZ(75) + 1) + 1;
+  beats = malloc(max_beats * sizeof(uint32_t));
+  if (NULL == data || NULL == beats)
+  {
+    fprintf(stderr, "%s: out of memory for %u samples\n", header, record.num_samples);
+    wfdb_close(&record);
+    free(data);
+    free(beats);
+    free(annotations);
+    return -1;
+  }
+
+  result->num_samples = wfdb_read(&record, data, record.num_samples);
+  wfdb_close(&record);
+
+  // The detectors report nothing until the initial threshold is known.
+  start = QRS_SAMPLES_FROM_256_HZ(350) + QRS_LOW_PASS_WINDOW_SIZE;
+  result->num_annotations = 0;
+  while (result->num_annotations < num_annotations &&
+         annotations[result->num_annotations] < start)
+  {
+    result->num_annotations++;
+  }
+  result->num_annotations = num_annotations - result->num_annotations;
+
+  num_beats = RunStream(data, result->num_samples, beats, annotations, num_annotations, result);
+  MatchBeats(beats, num_beats, annotations, num_annotations, start, &result->stream);
+
+  num_batch_beats = qrs_parallel_detect(data, result->num_samples, NULL, 1, beats, max_beats);
+  if (num_batch_beats < 0)
+  {
+    fprintf(stderr, "%s: out of memory\n", header);
+    free(data);
+    free(beats);
+    free(annotations);
+    return -1;
+  }
+
+  num_beats = num_batch_beats;
+  for (length = 0; length < num_beats; ++length)
+  {
+    beats[length] += kBatchLead - kStreamDelay;
+  }
+  MatchBeats(beats, num_beats, annotations, num_annotations, start, &result->batch);
+
+  RunBatchHeartrate(data, result->num_samples, annotations, num_annotations, result);
+  TimeBatchStages(data, result->num_samples, result);
+
+  free(data);
+  free(beats);
+  free(annotations);
+
+  return 0;
+}
+
+/**
+  @brief Benchmark the detector on a corpus of annotated WFDB records.
+  @note Prints one record,metric,value line per metric of each record and of
+        the total over all records, so runs before and after a change can be
+        compared line by line. Heartbeats are scored as in ANSI/AAMI EC57:
+        sensitivity TP / (TP + FN) and positive predictivity TP / (TP + FP),
+        matching within 150 ms of an annotation after the initial frame.
+        The heart rate error is the mean absolute difference between the
+        heart rate the firmware would show every DISPLAY_PERIOD and the mean
+        annotated heart rate of the WINDOW_SIZE samples before it.
+  */
+int main(int argc, char** argv)
+{
+  char record[256];
+  const char* annotator;
+  const char* name;
+  Result result;
+  Result total;
+  uint32_t num_records;
+  int i;
+
+  annotator = "atr";
+  i = 1;
+  if (argc > 2 && 0 == strcmp(argv[1], "-a"))
+  {
+    annotator = argv[2];
+    i = 3;
+  }
+
+  if (i >= argc)
+  {
+    fprintf(stderr, "usage: %s [-a annotator] <record.hea>...\n", argv[0]);
+    return 1;
+  }
+
+  memset(&total, 0, sizeof(total));
+  num_records = 0;
+  printf("record,metric,value\n");
+
+  for (; i < argc; ++i)
+  {
+    memset(&result, 0, sizeof(result));
+    if (RunRecord(argv[i], annotator, &result))
+    {
+      continue;
+    }
+
+    // The record is named by its header without the directory and ".hea".
+    name = strrchr(argv[i], '/');
+    name = name ? name + 1 : argv[i];
+    snprintf(record, sizeof(record), "%.*s", (int)strcspn(name, "."), name);
+    PrintResult(record, &result);
+    AddResult(&total, &result);
+    num_records++;
+  }
+
+  if (0 == num_records)
+  {
+    return 1;
+  }
+
+  PrintResult("total", &total);
+
+  return 0;
+}
@@ -0,0 +1,294 @@
+#include <stddef.h>
+#include <string.h>
+#include "qrs_long.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// The number of outputs computed from each block of prefix sums.
+#define CHUNK_SIZE 4096
+
+// The number of lanes of 32-bit sums in a vector.
+#define LANES 8
+
+#if defined(__AVX2__)
+
+/**
+  @brief Return the inclusive prefix sums of the 32-bit lanes plus carry.
+  @param  value  The terms.
+  @param  carry  The sum before the first term in every lane.
+  */
+static inline __m256i ScanLanes(__m256i value, __m256i carry)
+{
+  __m256i low_last;
+
+  // Sum within each 128-bit half, then add the last sum of the low half to
+  // the high half.
+  value = _mm256_add_epi32(value, _mm256_slli_si256(value, 4));
+  value = _mm256_add_epi32(value, _mm256_slli_si256(value, 8));
+  low_last = _mm256_shuffle_epi32(value, _MM_SHUFFLE(3, 3, 3, 3));
+  value = _mm256_add_epi32(value, _mm256_permute2x128_si256(low_last, low_last, 0x08));
+
+  return _mm256_add_epi32(value, carry);
+}
+
+/**
+  @brief Return the last lane in every lane.
+  */
+static inline __m256i BroadcastLastLane(__m256i value)
+{
+  return _mm256_permutevar8x32_epi32(value, _mm256_set1_epi32(LANES - 1));
+}
+
+/**
+  @brief Narrow 32-bit lanes that fit in 16 bits to 16-bit lanes.
+  */
+static inline __m128i NarrowLanes(__m256i value)
+{
+  return _mm256_castsi256_si128(
+      _mm256_permute4x64_epi64(_mm256_packus_epi32(value, value), 0xD8));
+}
+
+#endif // __AVX2__
+
+/**
+  @brief Write the running sums of count samples.
+  @param  data   The samples.
+  @param  sums   The sum of the samples up to and including each sample.
+  @param  count  The number of samples.
+  @param  carry  The sum before the first sample. Set to the last sum.
+  @note The sums wrap at the width of qrs_hp_sum_t like the scalar filter.
+  */
+static void ScanSamples(const uint16_t* data, qrs_hp_sum_t* sums, uint32_t count,
+                        qrs_hp_sum_t* carry)
+{
+  qrs_hp_sum_t sum;
+  uint32_t i;
+#if defined(__AVX2__)
+  __m256i lanes;
+  __m256i carry_lanes;
+#endif
+
+  sum = *carry;
+  i = 0;
+
+#if defined(__AVX2__)
+  // The 32-bit lane sums are narrowed back to the width of qrs_hp_sum_t.
+  carry_lanes = _mm256_set1_epi32(sum);
+  for (; i + LANES <= count; i += LANES)
+  {
+    lanes = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(data + i)));
+    lanes = ScanLanes(lanes, carry_lanes);
+    carry_lanes = BroadcastLastLane(lanes);
+#if QRS_HIGH_PASS_WINDOW_SHIFT <= 4
+    _mm_storeu_si128((__m128i*)(sums + i),
+                     NarrowLanes(_mm256_and_si256(lanes, _mm256_set1_epi32(0xFFFF))));
+#else
+    _mm256_storeu_si256((__m256i*)(sums + i), lanes);
+#endif
+  }
+  sum = _mm256_cvtsi256_si32(carry_lanes);
+#endif
+
+  for (; i < count; ++i)
+  {
+    sum += data[i];
+    sums[i] = sum;
+  }
+
+  *carry = sum;
+}
+
+void qrs_long_filter_high_pass(const uint16_t* data, uint16_t* data_hp, uint32_t size)
+{
+  // prefix[t] is the sum of the signal before sample start + 1 - M + t,
+  // where the signal before sample 0 is M copies of sample 0.
+  qrs_hp_sum_t prefix[QRS_HIGH_PASS_WINDOW_SIZE + CHUNK_SIZE];
+  qrs_hp_sum_t carry;
+  qrs_hp_sum_t y1_n;
+  uint16_t y2_n;
+  uint16_t first;
+  uint32_t start;
+  uint32_t length;
+  uint32_t n;
+  uint32_t i;
+#if defined(__AVX2__)
+  __m256i sums;
+  __m128i y1;
+  __m128i y2;
+#endif
+
+  if (0 == size)
+  {
+    return;
+  }
+
+  first = data[0];
+  for (i = 0; i < QRS_HIGH_PASS_WINDOW_SIZE; ++i)
+  {
+    prefix[i] = (qrs_hp_sum_t)((i + 1) * first);
+  }
+  carry = prefix[QRS_HIGH_PASS_WINDOW_SIZE - 1];
+
+  for (start = 0; start < size; start += length)
+  {
+    length = (size - start < CHUNK_SIZE) ? size - start : CHUNK_SIZE;
+
+    ScanSamples(data + start, prefix + QRS_HIGH_PASS_WINDOW_SIZE, length, &carry);
+
+    // The moving sum ending at sample n is prefix[M + i] - prefix[i]. The
+    // first M / 2 samples reuse sample 0 for y2.
+    i = 0;
+    for (; i < length && start + i < QRS_HIGH_PASS_WINDOW_SIZE / 2; ++i)
+    {
+      y1_n = (qrs_hp_sum_t)(prefix[QRS_HIGH_PASS_WINDOW_SIZE + i] - prefix[i]);
+      y1_n >>= QRS_HIGH_PASS_WINDOW_SHIFT;
+      data_hp[start + i] = (first > y1_n) ? first - y1_n : 0;
+    }
+
+#if defined(__AVX2__)
+    for (; i + LANES <= length; i += LANES)
+    {
+      n = start + i;
+#if QRS_HIGH_PASS_WINDOW_SHIFT <= 4
+      sums = _mm256_cvtepu16_epi32(_mm_sub_epi16(
+          _mm_loadu_si128((const __m128i*)(prefix + QRS_HIGH_PASS_WINDOW_SIZE + i)),
+          _mm_loadu_si128((const __m128i*)(prefix + i))));
+#else
+      sums = _mm256_sub_epi32(
+          _mm256_loadu_si256((const __m256i*)(prefix + QRS_HIGH_PASS_WINDOW_SIZE + i)),
+          _mm256_loadu_si256((const __m256i*)(prefix + i)));
+#endif
+      y1 = NarrowLanes(_mm256_srli_epi32(sums, QRS_HIGH_PASS_WINDOW_SHIFT));
+      y2 = _mm_loadu_si128((const __m128i*)(data + n - QRS_HIGH_PASS_WINDOW_SIZE / 2));
+
+      // y2 - y1 clamped at 0.
+      _mm_storeu_si128((__m128i*)(data_hp + n), _mm_subs_epu16(y2, y1));
+    }
+#endif
+
+    for (; i < length; ++i)
+    {
+      n = start + i;
+      y1_n = (qrs_hp_sum_t)(prefix[QRS_HIGH_PASS_WINDOW_SIZE + i] - prefix[i]);
+      y1_n >>= QRS_HIGH_PASS_WINDOW_SHIFT;
+      y2_n = data[n - QRS_HIGH_PASS_WINDOW_SIZE / 2];
+      data_hp[n] = (y2_n > y1_n) ? y2_n - y1_n : 0;
+    }
+
+    // Keep the sums the next chunk looks back at.
+    memmove(prefix, prefix + length, QRS_HIGH_PASS_WINDOW_SIZE * sizeof(qrs_hp_sum_t));
+  }
+}
+
+/**
+  @brief Write the running sums of count squared terms from first_term.
+  @param  data_hp      The high pass filtered signal.
+  @param  size         The number of samples of data_hp.
+  @param  last_square  The square of the last sample, used for the terms
+                       past the end.
+  @param  first_term   The index of the first term.
+  @param  sums         The sum of the terms up to and including each term.
+  @param  count        The number of terms.
+  @param  carry        The sum before the first term. Set to the last sum.
+  @note The sums wrap at 32 bits like the scalar filter.
+  */
+static void ScanSquares(const uint16_t* data_hp, uint32_t size, uint32_t last_square,
+                        uint32_t first_term, uint32_t* sums, uint32_t count,
+                        uint32_t* carry)
+{
+  uint32_t sum;
+  uint32_t j;
+  uint32_t i;
+#if defined(__AVX2__)
+  __m256i lanes;
+  __m256i carry_lanes;
+#endif
+
+  sum = *carry;
+  i = 0;
+  j = first_term;
+
+#if defined(__AVX2__)
+  carry_lanes = _mm256_set1_epi32(sum);
+  for (; i + LANES <= count && j + LANES <= size; i += LANES, j += LANES)
+  {
+    lanes = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(data_hp + j)));
+    lanes = ScanLanes(_mm256_mullo_epi32(lanes, lanes), carry_lanes);
+    carry_lanes = BroadcastLastLane(lanes);
+    _mm256_storeu_si256((__m256i*)(sums + i), lanes);
+  }
+  sum = _mm256_cvtsi256_si32(carry_lanes);
+#endif
+
+  for (; i < count; ++i, ++j)
+  {
+    sum += (j < size) ? (uint32_t)data_hp[j] * data_hp[j] : last_square;
+    sums[i] = sum;
+  }
+
+  *carry = sum;
+}
+
+void qrs_long_filter_low_pass(const uint16_t* data_hp, uint16_t* data_lp, uint32_t size)
+{
+  // prefix[t] is the sum of the squared terms before term start + t. The
+  // terms past the end are the last square.
+  uint32_t prefix[CHUNK_SIZE + QRS_LOW_PASS_WINDOW_SIZE + 1];
+  uint32_t last_square;
+  uint32_t carry;
+  uint32_t z_n;
+  uint32_t start;
+  uint32_t length;
+  uint32_t i;
+#if defined(__AVX2__)
+  const __m256i max_output = _mm256_set1_epi32(0xFFFF);
+  __m256i sums;
+#endif
+
+  if (0 == size)
+  {
+    return;
+  }
+
+  // Read before data_lp may overwrite data_hp.
+  last_square = (uint32_t)data_hp[size - 1] * data_hp[size - 1];
+
+  prefix[0] = 0;
+  carry = 0;
+  ScanSquares(data_hp, size, last_square, 0, prefix + 1, QRS_LOW_PASS_WINDOW_SIZE, &carry);
+
+  for (start = 0; start < size; start += length)
+  {
+    length = (size - start < CHUNK_SIZE) ? size - start : CHUNK_SIZE;
+
+    // The terms up to start + length + M are read before any of the
+    // outputs of this chunk are written.
+    ScanSquares(data_hp, size, last_square, start + QRS_LOW_PASS_WINDOW_SIZE,
+                prefix + QRS_LOW_PASS_WINDOW_SIZE + 1, length, &carry);
+
+    // The moving sum starting at term n is prefix[i + M] - prefix[i].
+    i = 0;
+
+#if defined(__AVX2__)
+    for (; i + LANES <= length; i += LANES)
+    {
+      sums = _mm256_sub_epi32(
+          _mm256_loadu_si256((const __m256i*)(prefix + QRS_LOW_PASS_WINDOW_SIZE + i)),
+          _mm256_loadu_si256((const __m256i*)(prefix + i)));
+      sums = _mm256_min_epu32(_mm256_srli_epi32(sums, QRS_LOW_PASS_OUTPUT_SHIFT), max_output);
+      _mm_storeu_si128((__m128i*)(data_lp + start + i), NarrowLanes(sums));
+    }
+#endif
+
+    for (; i < length; ++i)
+    {
+      z_n = (prefix[QRS_LOW_PASS_WINDOW_SIZE + i] - prefix[i]) >> QRS_LOW_PASS_OUTPUT_SHIFT;
+      data_lp[start + i] = (z_n > 0xFFFF) ? 0xFFFF : z_n;
+    }
+
+    // Keep the sums the next chunk starts from.
+    memmove(prefix, prefix + length, (QRS_LOW_PASS_WINDOW_SIZE + 1) * sizeof(uint32_t));
+  }
+}
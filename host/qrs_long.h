@@ -0,0 +1,32 @@
+#ifndef QRS_LONG_H
+#define QRS_LONG_H
+
+#include <stdint.h>
+#include "qrs.h"
+
+// Filters for long single-lead records such as 24-72 hour Holter recordings.
+// The moving sums of qrs_filter_high_pass and qrs_filter_low_pass are
+// computed as differences of prefix sums, which are summed a block of
+// samples at a time in vector lanes when built with AVX2 (e.g. -mavx2). The
+// sums wrap at the width of the scalar sums, so the outputs are bit-exact
+// with the scalar filters, including the saturation at 0xFFFF. The sizes
+// are 32-bit, and records longer than 65535 samples are filtered as the
+// scalar filters would filter them if their sizes were wider.
+
+/**
+  @brief Return the high pass filtered ECG signal (see qrs_filter_high_pass).
+  @param data      The raw ECG signal.
+  @param data_hp   The high pass filtered signal.
+  @param size      The number of samples.
+  */
+void qrs_long_filter_high_pass(const uint16_t* data, uint16_t* data_hp, uint32_t size);
+
+/**
+  @brief Return the low pass filtered ECG signal (see qrs_filter_low_pass).
+  @param data_hp   The high pass filtered signal.
+  @param data_lp   The low pass filtered signal. May be data_hp.
+  @param size      The number of samples.
+  */
+void qrs_long_filter_low_pass(const uint16_t* data_hp, uint16_t* data_lp, uint32_t size);
+
+#endif // QRS_LONG_H
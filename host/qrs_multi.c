@@ -0,0 +1,469 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include "fastdiv.h"
+#include "qrs_multi.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/**
+  @brief A function of qrs.h that filters one channel.
+  */
+typedef void (*ChannelFilter)(uint16_t* in, uint16_t* out, uint16_t size);
+
+/**
+  @brief Run a scalar filter on each channel from first_channel.
+  @note Each channel is copied out of the rows and back, so the results are
+        those of the scalar filter by construction.
+  @return 0 on success, or -1 if memory could not be allocated.
+  */
+static int FilterChannels(ChannelFilter filter, const uint16_t* in, uint16_t* out,
+                           uint16_t first_channel, uint16_t num_channels, uint16_t size)
+{
+  uint16_t* channel_in;
+  uint16_t* channel_out;
+  uint16_t c;
+  uint16_t n;
+
+  if (first_channel >= num_channels || 0 == size)
+  {
+    return 0;
+  }
+
+  channel_in = malloc(2 * size * sizeof(uint16_t));
+  if (NULL == channel_in)
+  {
+    return -1;
+  }
+
+  channel_out = channel_in + size;
+
+  for (c = first_channel; c < num_channels; ++c)
+  {
+    for (n = 0; n < size; ++n)
+    {
+      channel_in[n] = in[(size_t)n * num_channels + c];
+    }
+
+    filter(channel_in, channel_out, size);
+
+    for (n = 0; n < size; ++n)
+    {
+      out[(size_t)n * num_channels + c] = channel_out[n];
+    }
+  }
+
+  free(channel_in);
+
+  return 0;
+}
+
+/**
+  @brief Run the scalar detection on each channel from first_channel.
+  @return 0 on success, or -1 if memory could not be allocated.
+  */
+static int DetectChannels(const uint16_t* data_lp, uint16_t* data_qrs, uint16_t* heartrates,
+                           uint16_t first_channel, uint16_t num_channels, uint16_t size)
+{
+  uint16_t* channel_lp;
+  uint16_t* channel_qrs;
+  uint16_t c;
+  uint16_t n;
+
+  if (first_channel >= num_channels)
+  {
+    return 0;
+  }
+
+  channel_lp = malloc((2 * size + 1) * sizeof(uint16_t));
+  if (NULL == channel_lp)
+  {
+    return -1;
+  }
+
+  channel_qrs = channel_lp + size;
+
+  for (c = first_channel; c < num_channels; ++c)
+  {
+    for (n = 0; n < size; ++n)
+    {
+      channel_lp[n] = data_lp[(size_t)n * num_channels + c];
+    }
+
+    heartrates[c] = qrs_get_heartrate(channel_lp, data_qrs ? channel_qrs : NULL, NULL, size);
+
+    if (data_qrs)
+    {
+      for (n = 0; n < size; ++n)
+      {
+        data_qrs[(size_t)n * num_channels + c] = channel_qrs[n];
+      }
+    }
+  }
+
+  free(channel_lp);
+
+  return 0;
+}
+
+#if defined(__AVX2__)
+
+/**
+  @brief Load the lanes of a group from row n.
+  */
+static inline __m256i LoadRow(const uint16_t* data, size_t stride, uint16_t n)
+{
+  return _mm256_loadu_si256((const __m256i*)(data + n * stride));
+}
+
+/**
+  @brief Store the lanes of a group to row n.
+  */
+static inline void StoreRow(uint16_t* data, size_t stride, uint16_t n, __m256i value)
+{
+  _mm256_storeu_si256((__m256i*)(data + n * stride), value);
+}
+
+/**
+  @brief High pass filter the group of lanes from data (see NextHighPass).
+  @note data and data_hp point at the first lane of the group.
+  */
+static void HighPassGroup(const uint16_t* data, uint16_t* data_hp, size_t stride, uint16_t size)
+{
+  __m256i first;
+  __m256i newest;
+  __m256i oldest;
+  __m256i y1;
+  __m256i y2;
+  uint16_t n;
+#if QRS_HIGH_PASS_WINDOW_SHIFT <= 4
+  __m256i sum;
+#else
+  __m256i sum_low;
+  __m256i sum_high;
+#endif
+
+  // The first sample is reused while the trailing indexes would be negative.
+  first = LoadRow(data, stride, 0);
+
+#if QRS_HIGH_PASS_WINDOW_SHIFT <= 4
+  // The 16-bit sum wraps like qrs_hp_sum_t.
+  sum = _mm256_slli_epi16(first, QRS_HIGH_PASS_WINDOW_SHIFT);
+#else
+  sum_low = _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(first)),
+                              QRS_HIGH_PASS_WINDOW_SHIFT);
+  sum_high = _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(first, 1)),
+                               QRS_HIGH_PASS_WINDOW_SHIFT);
+#endif
+
+  for (n = 0; n < size; ++n)
+  {
+    newest = LoadRow(data, stride, n);
+    oldest = (n < QRS_HIGH_PASS_WINDOW_SIZE) ?
+             first : LoadRow(data, stride, n - QRS_HIGH_PASS_WINDOW_SIZE);
+    y2 = (n < QRS_HIGH_PASS_WINDOW_SIZE / 2) ?
+         first : LoadRow(data, stride, n - QRS_HIGH_PASS_WINDOW_SIZE / 2);
+
+#if QRS_HIGH_PASS_WINDOW_SHIFT <= 4
+    sum = _mm256_add_epi16(_mm256_sub_epi16(sum, oldest), newest);
+    y1 = _mm256_srli_epi16(sum, QRS_HIGH_PASS_WINDOW_SHIFT);
+#else
+    sum_low = _mm256_add_epi32(
+        _mm256_sub_epi32(sum_low, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(oldest))),
+        _mm256_cvtepu16_epi32(_mm256_castsi256_si128(newest)));
+    sum_high = _mm256_add_epi32(
+        _mm256_sub_epi32(sum_high, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(oldest, 1))),
+        _mm256_cvtepu16_epi32(_mm256_extracti128_si256(newest, 1)));
+
+    // The averages fit in 16 bits. Packing interleaves the 128-bit halves.
+    y1 = _mm256_permute4x64_epi64(
+        _mm256_packus_epi32(_mm256_srli_epi32(sum_low, QRS_HIGH_PASS_WINDOW_SHIFT),
+                            _mm256_srli_epi32(sum_high, QRS_HIGH_PASS_WINDOW_SHIFT)),
+        0xD8);
+#endif
+
+    // y2 - y1 clamped at 0.
+    StoreRow(data_hp, stride, n, _mm256_subs_epu16(y2, y1));
+  }
+}
+
+/**
+  @brief Square each lane into two vectors of 32-bit lanes.
+  @note low holds lanes 0-3 and 8-11, high holds lanes 4-7 and 12-15.
+  */
+static inline void SquareLanes(__m256i value, __m256i* low, __m256i* high)
+{
+  __m256i product_low;
+  __m256i product_high;
+
+  product_low = _mm256_mullo_epi16(value, value);
+  product_high = _mm256_mulhi_epu16(value, value);
+
+  *low = _mm256_unpacklo_epi16(product_low, product_high);
+  *high = _mm256_unpackhi_epi16(product_low, product_high);
+}
+
+/**
+  @brief Low pass filter the group of lanes from data_hp (see qrs_filter_low_pass).
+  @note data_hp and data_lp point at the first lane of the group.
+  */
+static void LowPassGroup(const uint16_t* data_hp, uint16_t* data_lp, size_t stride, uint16_t size)
+{
+  const __m256i max_output = _mm256_set1_epi32(0xFFFF);
+  __m256i last_low;
+  __m256i last_high;
+  __m256i z_low;
+  __m256i z_high;
+  __m256i square_low;
+  __m256i square_high;
+  __m256i next_low;
+  __m256i next_high;
+  __m256i out_low;
+  __m256i out_high;
+  uint16_t n;
+
+  // For the last several terms, reuse the last term for the moving average.
+  SquareLanes(LoadRow(data_hp, stride, size - 1), &last_low, &last_high);
+
+  // Sum up the first QRS_LOW_PASS_WINDOW_SIZE squared terms. The 32-bit
+  // sums wrap like the scalar sum.
+  z_low = _mm256_setzero_si256();
+  z_high = _mm256_setzero_si256();
+  for (n = 0; n < QRS_LOW_PASS_WINDOW_SIZE; ++n)
+  {
+    if (n < size)
+    {
+      SquareLanes(LoadRow(data_hp, stride, n), &square_low, &square_high);
+    }
+    else
+    {
+      square_low = last_low;
+      square_high = last_high;
+    }
+    z_low = _mm256_add_epi32(z_low, square_low);
+    z_high = _mm256_add_epi32(z_high, square_high);
+  }
+
+  for (n = 0; n < size; ++n)
+  {
+    // Read the term leaving the window before the row may be overwritten.
+    SquareLanes(LoadRow(data_hp, stride, n), &square_low, &square_high);
+    if (n + QRS_LOW_PASS_WINDOW_SIZE < size)
+    {
+      SquareLanes(LoadRow(data_hp, stride, n + QRS_LOW_PASS_WINDOW_SIZE), &next_low, &next_high);
+    }
+    else
+    {
+      next_low = last_low;
+      next_high = last_high;
+    }
+
+    // Scale and saturate at 0xFFFF. Packing the two halves restores the
+    // lane order.
+    out_low = _mm256_min_epu32(_mm256_srli_epi32(z_low, QRS_LOW_PASS_OUTPUT_SHIFT), max_output);
+    out_high = _mm256_min_epu32(_mm256_srli_epi32(z_high, QRS_LOW_PASS_OUTPUT_SHIFT), max_output);
+    StoreRow(data_lp, stride, n, _mm256_packus_epi32(out_low, out_high));
+
+    z_low = _mm256_add_epi32(_mm256_sub_epi32(z_low, square_low), next_low);
+    z_high = _mm256_add_epi32(_mm256_sub_epi32(z_high, square_high), next_high);
+  }
+}
+
+/**
+  @brief Detect the heartbeats of the group of lanes (see qrs_get_heartrate).
+  @note Only for tunings whose peak window is the decision frame, so the
+        peak of each frame is a running maximum. The rare heartbeats and
+        threshold updates are done lane by lane.
+  */
+static void DetectGroup(const qrs_params_t* params, const uint16_t* data_lp, uint16_t* data_qrs,
+                        uint16_t* heartrates, size_t stride, uint16_t size)
+{
+  const __m256i one = _mm256_set1_epi16(1);
+  const __m256i min_samples = _mm256_set1_epi16(params->min_samples_between_beats);
+  uint16_t lane_threshold[QRS_MULTI_LANES];
+  uint16_t lane_peak[QRS_MULTI_LANES];
+  uint16_t lane_since[QRS_MULTI_LANES];
+  uint16_t heartbeat_count[QRS_MULTI_LANES];
+  uint16_t heartrate_sum[QRS_MULTI_LANES];
+  __m256i threshold;
+  __m256i peak;
+  __m256i since;
+  __m256i lp;
+  __m256i is_beat;
+  __m256i is_too_soon;
+  uint32_t mask;
+  uint16_t frame_count;
+  uint16_t lane;
+  uint16_t i;
+
+  // The initial threshold is the largest value of the first frame.
+  threshold = _mm256_setzero_si256();
+  for (i = 0; i < params->initial_frame_size && i < size; ++i)
+  {
+    threshold = _mm256_max_epu16(threshold, LoadRow(data_lp, stride, i));
+  }
+
+  peak = _mm256_setzero_si256();
+  since = _mm256_setzero_si256();
+  frame_count = 0;
+  for (lane = 0; lane < QRS_MULTI_LANES; ++lane)
+  {
+    heartbeat_count[lane] = 0;
+    heartrate_sum[lane] = 0;
+  }
+
+  for (i = 0; i < size; ++i)
+  {
+    lp = LoadRow(data_lp, stride, i);
+    peak = _mm256_max_epu16(peak, lp);
+
+    // A heartbeat needs more than min_samples since the last one and the
+    // output at or above the threshold. Unsigned a <= b is max(a, b) == b.
+    is_too_soon = _mm256_cmpeq_epi16(_mm256_max_epu16(since, min_samples), min_samples);
+    is_beat = _mm256_andnot_si256(is_too_soon,
+                                  _mm256_cmpeq_epi16(_mm256_max_epu16(lp, threshold), lp));
+
+    if (data_qrs)
+    {
+      StoreRow(data_qrs, stride, i, _mm256_srli_epi16(is_beat, 15));
+    }
+
+    mask = _mm256_movemask_epi8(is_beat);
+    if (mask)
+    {
+      _mm256_storeu_si256((__m256i*)lane_since, since);
+      for (lane = 0; lane < QRS_MULTI_LANES; ++lane)
+      {
+        // The first interval is from the start of the window.
+        if ((mask >> (2 * lane)) & 1 && heartbeat_count[lane] < QRS_MAX_AVERAGED_BEATS)
+        {
+          if (heartbeat_count[lane] > 0)
+          {
+            heartrate_sum[lane] += 60L * QRS_SAMPLING_FREQUENCY / lane_since[lane];
+          }
+          heartbeat_count[lane]++;
+        }
+      }
+    }
+
+    since = _mm256_andnot_si256(is_beat, _mm256_add_epi16(since, one));
+
+    frame_count++;
+    if (frame_count >= params->decide_frame_size)
+    {
+      _mm256_storeu_si256((__m256i*)lane_threshold, threshold);
+      _mm256_storeu_si256((__m256i*)lane_peak, peak);
+      for (lane = 0; lane < QRS_MULTI_LANES; ++lane)
+      {
+        lane_threshold[lane] = ((uint32_t)params->alpha_times_gamma * lane_peak[lane] +
+                                (uint32_t)params->one_minus_alpha * lane_threshold[lane]) >> 10;
+      }
+      threshold = _mm256_loadu_si256((const __m256i*)lane_threshold);
+      peak = _mm256_setzero_si256();
+      frame_count = 0;
+    }
+  }
+
+  for (lane = 0; lane < QRS_MULTI_LANES; ++lane)
+  {
+    heartrates[lane] = (heartbeat_count[lane] < 2) ? 0 :
+                       fastdiv_divide(heartrate_sum[lane],
+                                      FASTDIV_RECIPROCAL(heartbeat_count[lane] - 1));
+  }
+}
+
+#endif // __AVX2__
+
+/**
+  @brief Return the number of channels that are run in groups of lanes.
+  */
+static uint16_t GetNumGroupedChannels(uint16_t num_channels)
+{
+#if defined(__AVX2__)
+  return num_channels - num_channels % QRS_MULTI_LANES;
+#else
+  (void)num_channels;
+  return 0;
+#endif
+}
+
+int qrs_multi_filter_high_pass(const uint16_t* data, uint16_t* data_hp,
+                               uint16_t num_channels, uint16_t size)
+{
+  uint16_t num_grouped;
+#if defined(__AVX2__)
+  uint16_t c;
+#endif
+
+  if (0 == size)
+  {
+    return 0;
+  }
+
+  num_grouped = GetNumGroupedChannels(num_channels);
+
+#if defined(__AVX2__)
+  for (c = 0; c < num_grouped; c += QRS_MULTI_LANES)
+  {
+    HighPassGroup(data + c, data_hp + c, num_channels, size);
+  }
+#endif
+
+  return FilterChannels(qrs_filter_high_pass, data, data_hp, num_grouped, num_channels, size);
+}
+
+int qrs_multi_filter_low_pass(const uint16_t* data_hp, uint16_t* data_lp,
+                              uint16_t num_channels, uint16_t size)
+{
+  uint16_t num_grouped;
+#if defined(__AVX2__)
+  uint16_t c;
+#endif
+
+  if (0 == size)
+  {
+    return 0;
+  }
+
+  num_grouped = GetNumGroupedChannels(num_channels);
+
+#if defined(__AVX2__)
+  for (c = 0; c < num_grouped; c += QRS_MULTI_LANES)
+  {
+    LowPassGroup(data_hp + c, data_lp + c, num_channels, size);
+  }
+#endif
+
+  return FilterChannels(qrs_filter_low_pass, data_hp, data_lp, num_grouped, num_channels, size);
+}
+
+int qrs_multi_get_heartrate(const uint16_t* data_lp, uint16_t* data_qrs,
+                            uint16_t* heartrates, uint16_t num_channels,
+                            uint16_t size)
+{
+  qrs_params_t params;
+  uint16_t num_grouped;
+#if defined(__AVX2__)
+  uint16_t c;
+#endif
+
+  // The batch detection always runs with the default tuning.
+  qrs_params_init(&params);
+
+  num_grouped = GetNumGroupedChannels(num_channels);
+  if (params.peak_window_size != params.decide_frame_size)
+  {
+    num_grouped = 0;
+  }
+
+#if defined(__AVX2__)
+  for (c = 0; c < num_grouped; c += QRS_MULTI_LANES)
+  {
+    DetectGroup(&params, data_lp + c, data_qrs ? data_qrs + c : NULL,
+                heartrates + c, num_channels, size);
+  }
+#endif
+
+  return DetectChannels(data_lp, data_qrs, heartrates, num_grouped, num_channels, size);
+}
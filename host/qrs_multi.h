@@ -0,0 +1,59 @@
+#ifndef QRS_MULTI_H
+#define QRS_MULTI_H
+
+#include <stdint.h>
+#include "qrs.h"
+
+// Batch QRS detection of many independent channels at once.
+// The channels are stored as a structure of arrays: sample n of channel c is
+// at [n * num_channels + c], so a row holds one sample of every channel and a
+// vector register holds one lane per channel. Built with AVX2 (e.g. -mavx2),
+// each group of QRS_MULTI_LANES channels runs in 16- and 32-bit integer
+// lanes. The remaining channels, and all channels without AVX2, run the
+// scalar functions of qrs.h one channel at a time. The outputs are bit-exact
+// with running qrs_filter_high_pass, qrs_filter_low_pass and
+// qrs_get_heartrate on each channel.
+
+/**
+  @brief The number of channels filtered together in one group of lanes.
+  */
+#define QRS_MULTI_LANES 16
+
+/**
+  @brief Return the high pass filtered ECG signal of each channel.
+  @param data          The raw ECG signals, size rows of num_channels.
+  @param data_hp       The high pass filtered signals, in the same layout.
+  @param num_channels  The number of channels.
+  @param size          The number of samples of each channel.
+  @return 0 on success, or -1 if memory could not be allocated.
+  */
+int qrs_multi_filter_high_pass(const uint16_t* data, uint16_t* data_hp,
+                               uint16_t num_channels, uint16_t size);
+
+/**
+  @brief Return the low pass filtered ECG signal of each channel.
+  @param data_hp       The high pass filtered signals, size rows of num_channels.
+  @param data_lp       The low pass filtered signals, in the same layout.
+                       May be data_hp.
+  @param num_channels  The number of channels.
+  @param size          The number of samples of each channel.
+  @return 0 on success, or -1 if memory could not be allocated.
+  */
+int qrs_multi_filter_low_pass(const uint16_t* data_hp, uint16_t* data_lp,
+                              uint16_t num_channels, uint16_t size);
+
+/**
+  @brief Detect the heartbeats of each channel.
+  @param data_lp       The low pass filtered signals, size rows of num_channels.
+  @param data_qrs      1 at each heartbeat, otherwise 0, in the same layout,
+                       or NULL.
+  @param heartrates    The heart rate of each channel (see qrs_get_heartrate).
+  @param num_channels  The number of channels.
+  @param size          The number of samples of each channel.
+  @return 0 on success, or -1 if memory could not be allocated.
+  */
+int qrs_multi_get_heartrate(const uint16_t* data_lp, uint16_t* data_qrs,
+                            uint16_t* heartrates, uint16_t num_channels,
+                            uint16_t size);
+
+#endif // QRS_MULTI_H
@@ -0,0 +1,584 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "qrs_long.h"
+#include "qrs_parallel.h"
+
+/**
+  @brief The record shared by the threads.
+  */
+typedef struct {
+  const uint16_t* data;    // The raw ECG signal.
+  uint32_t size;           // The number of samples.
+  qrs_params_t params;     // The tuning.
+  uint16_t* data_lp;       // The low pass output of the whole record.
+  uint16_t* frame_peaks;   // The peak at the end of each full decision frame.
+  uint16_t* thresholds;    // The threshold in effect during each frame.
+  uint32_t num_frames;     // The number of entries of thresholds.
+} Record;
+
+/**
+  @brief The part of a record processed by one thread.
+  */
+typedef struct {
+  Record* record;
+  uint32_t start;          // The first sample.
+  uint32_t end;            // One past the last sample.
+  uint16_t* scratch;       // The filter outputs of the chunk and its halos.
+  uint32_t first_allowed;  // The first sample a heartbeat was allowed at.
+  uint32_t* beats;         // The heartbeats found from first_allowed.
+  uint32_t num_beats;      // The number of entries of beats.
+  uint32_t first_frame;    // The first threshold update of the chunk.
+  uint32_t end_frame;      // One past the last threshold update.
+  uint16_t entry_low;      // The lowest threshold the updates can start from.
+  uint16_t entry_high;     // The highest threshold the updates can start from.
+  uint16_t exit_low;       // The threshold after the updates from 0.
+  uint16_t exit_high;      // The threshold after the updates from 0xFFFF.
+  uint16_t* exits;         // The threshold after the updates from each entry.
+} Chunk;
+
+/**
+  @brief Low pass filter a chunk into the low pass output of the record.
+  @note The high pass filter starts a window of raw samples early and the
+        low pass filter reads a window of high pass outputs past the end,
+        so the outputs are the same as filtering the whole record.
+  */
+static void *FilterChunk(void* arg)
+{
+  Chunk* chunk;
+  Record* record;
+  uint32_t first;
+  uint32_t last;
+
+  chunk = arg;
+  record = chunk->record;
+
+  if (chunk->start == chunk->end)
+  {
+    return NULL;
+  }
+
+  first = (chunk->start > QRS_HIGH_PASS_WINDOW_SIZE) ?
+          chunk->start - QRS_HIGH_PASS_WINDOW_SIZE : 0;
+  last = (record->size - chunk->end > QRS_LOW_PASS_WINDOW_SIZE) ?
+         chunk->end + QRS_LOW_PASS_WINDOW_SIZE : record->size;
+
+  qrs_long_filter_high_pass(record->data + first, chunk->scratch, last - first);
+  qrs_long_filter_low_pass(chunk->scratch + (chunk->start - first),
+                           chunk->scratch + (chunk->start - first), last - chunk->start);
+
+  memcpy(record->data_lp + chunk->start, chunk->scratch + (chunk->start - first),
+         (chunk->end - chunk->start) * sizeof(uint16_t));
+
+  return NULL;
+}
+
+/**
+  @brief Find the peak of each decision frame that ends in a chunk.
+  @note The peak is the largest of the last peak_window_size low pass
+        outputs, as qrs_peak_t tracks it. The window may reach back into the
+        chunk before.
+  */
+static void *FindChunkPeaks(void* arg)
+{
+  Chunk* chunk;
+  Record* record;
+  uint32_t frame_size;
+  uint32_t window;
+  uint32_t i;
+  uint32_t j;
+  uint16_t peak;
+
+  chunk = arg;
+  record = chunk->record;
+  frame_size = record->params.decide_frame_size;
+  window = record->params.peak_window_size;
+
+  for (i = chunk->start / frame_size * frame_size + frame_size - 1; i < chunk->end;
+       i += frame_size)
+  {
+    peak = 0;
+    for (j = (i + 1 > window) ? i + 1 - window : 0; j <= i; ++j)
+    {
+      if (record->data_lp[j] > peak)
+      {
+        peak = record->data_lp[j];
+      }
+    }
+    record->frame_peaks[i / frame_size] = peak;
+  }
+
+  return NULL;
+}
+
+/**
+  @brief Detect the heartbeats of a chunk.
+  @note The first chunk starts like qrs_get_heartrate. The others start as if
+        no heartbeat came just before them, which is corrected in order by
+        qrs_parallel_detect.
+  */
+static void *DetectChunk(void* arg)
+{
+  Chunk* chunk;
+  Record* record;
+  uint32_t next_allowed;
+  uint32_t frame;
+  uint16_t frame_count;
+  uint16_t threshold;
+  uint32_t i;
+
+  chunk = arg;
+  record = chunk->record;
+  chunk->num_beats = 0;
+
+  // A heartbeat is only allowed from next_allowed on.
+  next_allowed = (0 == chunk->start) ?
+                 record->params.min_samples_between_beats + 1U : chunk->start;
+  chunk->first_allowed = next_allowed;
+  frame = chunk->start / record->params.decide_frame_size;
+  frame_count = chunk->start % record->params.decide_frame_size;
+  threshold = record->thresholds[frame];
+
+  for (i = chunk->start; i < chunk->end; ++i)
+  {
+    if (i >= next_allowed && record->data_lp[i] >= threshold)
+    {
+      chunk->beats[chunk->num_beats++] = i;
+      next_allowed = i + record->params.min_samples_between_beats + 2;
+    }
+
+    if (++frame_count >= record->params.decide_frame_size)
+    {
+      frame_count = 0;
+      threshold = record->thresholds[++frame];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  @brief Run a step on every chunk, one thread per chunk.
+  @note The first chunk runs on the calling thread. A chunk whose thread
+        cannot be started also runs on the calling thread.
+  */
+static void RunChunks(Chunk* chunks, uint16_t num_chunks, void *(*step)(void*))
+{
+  pthread_t threads[QRS_PARALLEL_MAX_THREADS];
+  uint16_t is_started[QRS_PARALLEL_MAX_THREADS];
+  uint16_t c;
+
+  for (c = 1; c < num_chunks; ++c)
+  {
+    is_started[c] = (0 == pthread_create(&threads[c], NULL, step, &chunks[c]));
+  }
+
+  step(&chunks[0]);
+
+  for (c = 1; c < num_chunks; ++c)
+  {
+    if (is_started[c])
+    {
+      pthread_join(threads[c], NULL);
+    }
+    else
+    {
+      step(&chunks[c]);
+    }
+  }
+}
+
+/**
+  @brief Return the threshold of the next decision frame.
+  @note The same update as the batch detector (see CalculateNewThreshold).
+  */
+static inline uint16_t NextThreshold(const qrs_params_t* params, uint16_t threshold,
+                                     uint16_t peak)
+{
+  // Scaled by 2^10.
+  return ((uint32_t)params->alpha_times_gamma * peak +
+          (uint32_t)params->one_minus_alpha * threshold) >> 10;
+}
+
+/**
+  @brief Set the initial threshold to the peak of the initial frame.
+  */
+static void StartThresholds(Record* record)
+{
+  uint32_t i;
+  uint16_t peak;
+
+  peak = 0;
+  for (i = 0; i < record->params.initial_frame_size && i < record->size; ++i)
+  {
+    if (record->data_lp[i] > peak)
+    {
+      peak = record->data_lp[i];
+    }
+  }
+
+  record->thresholds[0] = peak;
+}
+
+/**
+  @brief Chain the thresholds of the decision frames one after the other.
+  */
+static void ChainThresholds(Record* record)
+{
+  uint32_t k;
+
+  for (k = 0; k + 1 < record->num_frames; ++k)
+  {
+    record->thresholds[k + 1] = NextThreshold(&record->params, record->thresholds[k],
+                                              record->frame_peaks[k]);
+  }
+}
+
+#if QRS_PARALLEL_SCAN_THRESHOLDS == 1
+
+/**
+  @brief Find the thresholds after the updates of a chunk from 0 and 0xFFFF.
+  @note The update is monotonic, so every threshold leaving the chunk is
+        between the two.
+  */
+static void *BoundChunkThresholds(void* arg)
+{
+  Chunk* chunk;
+  Record* record;
+  uint32_t k;
+
+  chunk = arg;
+  record = chunk->record;
+  chunk->exit_low = 0;
+  chunk->exit_high = 0xFFFF;
+
+  for (k = chunk->first_frame; k < chunk->end_frame; ++k)
+  {
+    chunk->exit_low = NextThreshold(&record->params, chunk->exit_low, record->frame_peaks[k]);
+    chunk->exit_high = NextThreshold(&record->params, chunk->exit_high, record->frame_peaks[k]);
+  }
+
+  return NULL;
+}
+
+/**
+  @brief Find the threshold after the updates of a chunk from every entry.
+  @note The entries are grouped into runs that have reached the same
+        threshold. The update is monotonic, so each run is a range of
+        entries, and the runs merge as the updates pull the thresholds
+        together. Each update costs one step per run rather than per entry.
+  */
+static void *MapChunkThresholds(void* arg)
+{
+  Chunk* chunk;
+  Record* record;
+  uint16_t* values;
+  uint16_t* firsts;
+  uint16_t value;
+  uint32_t width;
+  uint32_t num_runs;
+  uint32_t i;
+  uint32_t j;
+  uint32_t k;
+
+  chunk = arg;
+  record = chunk->record;
+  width = chunk->entry_high - chunk->entry_low + 1;
+
+  // The threshold of each run and the offset of its first entry.
+  values = chunk->exits + width;
+  firsts = values + width;
+  for (i = 0; i < width; ++i)
+  {
+    values[i] = chunk->entry_low + i;
+    firsts[i] = i;
+  }
+  num_runs = width;
+
+  for (k = chunk->first_frame; k < chunk->end_frame; ++k)
+  {
+    j = 0;
+    for (i = 0; i < num_runs; ++i)
+    {
+      value = NextThreshold(&record->params, values[i], record->frame_peaks[k]);
+      if (j > 0 && values[j - 1] == value)
+      {
+        continue;
+      }
+      values[j] = value;
+      firsts[j] = firsts[i];
+      j++;
+    }
+    num_runs = j;
+  }
+
+  for (i = 0, j = 0; i < width; ++i)
+  {
+    if (j + 1 < num_runs && firsts[j + 1] == i)
+    {
+      j++;
+    }
+    chunk->exits[i] = values[j];
+  }
+
+  return NULL;
+}
+
+/**
+  @brief Fill in the thresholds of a chunk from its entry threshold.
+  @note The entry and exit thresholds are already set, so the chunks do not
+        write the same entries.
+  */
+static void *ApplyChunkThresholds(void* arg)
+{
+  Chunk* chunk;
+  Record* record;
+  uint32_t k;
+
+  chunk = arg;
+  record = chunk->record;
+
+  for (k = chunk->first_frame; k + 1 < chunk->end_frame; ++k)
+  {
+    record->thresholds[k + 1] = NextThreshold(&record->params, record->thresholds[k],
+                                              record->frame_peaks[k]);
+  }
+
+  return NULL;
+}
+
+/**
+  @brief Find the thresholds of the decision frames with a scan over chunks.
+  @return 1, or 0 if memory could not be allocated.
+  @note Each chunk maps the threshold entering its frames to the threshold
+        leaving them. The map is a composition of monotonic integer steps
+        rather than an affine map, since each update rounds down. The maps
+        are found in parallel over the small range of thresholds each chunk
+        can be entered with, chained in order (one lookup per chunk) and the
+        thresholds inside each chunk are filled in in parallel.
+  */
+static uint16_t ScanThresholds(Record* record, Chunk* chunks, uint16_t num_chunks)
+{
+  uint16_t threshold;
+  uint16_t is_allocated;
+  uint16_t c;
+
+  for (c = 0; c < num_chunks; ++c)
+  {
+    chunks[c].first_frame = (uint64_t)(record->num_frames - 1) * c / num_chunks;
+    chunks[c].end_frame = (uint64_t)(record->num_frames - 1) * (c + 1) / num_chunks;
+  }
+
+  RunChunks(chunks, num_chunks, BoundChunkThresholds);
+
+  is_allocated = 1;
+  for (c = 0; c < num_chunks; ++c)
+  {
+    chunks[c].entry_low = (0 == c) ? record->thresholds[0] : chunks[c - 1].exit_low;
+    chunks[c].entry_high = (0 == c) ? record->thresholds[0] : chunks[c - 1].exit_high;
+
+    // The exits, then the run values and offsets.
+    chunks[c].exits = malloc(3 * (chunks[c].entry_high - chunks[c].entry_low + 1) *
+                             sizeof(uint16_t));
+    is_allocated = is_allocated && chunks[c].exits;
+  }
+
+  if (is_allocated)
+  {
+    RunChunks(chunks, num_chunks, MapChunkThresholds);
+
+    threshold = record->thresholds[0];
+    for (c = 0; c < num_chunks; ++c)
+    {
+      record->thresholds[chunks[c].first_frame] = threshold;
+      threshold = chunks[c].exits[threshold - chunks[c].entry_low];
+    }
+    record->thresholds[record->num_frames - 1] = threshold;
+
+    RunChunks(chunks, num_chunks, ApplyChunkThresholds);
+  }
+
+  for (c = 0; c < num_chunks; ++c)
+  {
+    free(chunks[c].exits);
+  }
+
+  return is_allocated;
+}
+
+#endif // QRS_PARALLEL_SCAN_THRESHOLDS
+
+/**
+  @brief Append a heartbeat to the output.
+  */
+static inline void AppendBeat(uint32_t* beats, uint32_t max_beats, uint32_t* count, uint32_t i)
+{
+  if (*count < max_beats)
+  {
+    beats[*count] = i;
+  }
+  (*count)++;
+}
+
+/**
+  @brief Append the heartbeats of a chunk given the heartbeats before it.
+  @param  record        The record.
+  @param  chunk         The chunk, detected as if no heartbeat came before it.
+  @param  next_allowed  The first sample a heartbeat is allowed at after the
+                        chunks before. Updated for the chunks after.
+  @note The start of the chunk is detected again until it is in the same
+        state as the chunk's own detection, which is after the first
+        heartbeat both find or once both are past the shortest interval.
+        The rest of the chunk's heartbeats are kept.
+  */
+static void AppendChunk(const Record* record, const Chunk* chunk, uint32_t* next_allowed,
+                        uint32_t* beats, uint32_t max_beats, uint32_t* count)
+{
+  uint32_t chunk_next_allowed;
+  uint32_t min_interval;
+  uint32_t k;
+  uint32_t i;
+
+  min_interval = record->params.min_samples_between_beats + 2;
+  chunk_next_allowed = chunk->first_allowed;
+  k = 0;
+
+  for (i = chunk->start; i < chunk->end; ++i)
+  {
+    while (k < chunk->num_beats && chunk->beats[k] < i)
+    {
+      chunk_next_allowed = chunk->beats[k++] + min_interval;
+    }
+
+    if (*next_allowed == chunk_next_allowed ||
+        (i >= *next_allowed && i >= chunk_next_allowed))
+    {
+      break;
+    }
+
+    if (i >= *next_allowed &&
+        record->data_lp[i] >= record->thresholds[i / record->params.decide_frame_size])
+    {
+      AppendBeat(beats, max_beats, count, i);
+      *next_allowed = i + min_interval;
+    }
+  }
+
+  if (i < chunk->end)
+  {
+    for (; k < chunk->num_beats; ++k)
+    {
+      AppendBeat(beats, max_beats, count, chunk->beats[k]);
+      *next_allowed = chunk->beats[k] + min_interval;
+    }
+  }
+}
+
+int32_t qrs_parallel_detect(const uint16_t* data, uint32_t size,
+                            const qrs_params_t* params, uint16_t num_threads,
+                            uint32_t* beats, uint32_t max_beats)
+{
+  Chunk chunks[QRS_PARALLEL_MAX_THREADS];
+  Record record;
+  uint32_t next_allowed;
+  uint32_t count;
+  uint32_t length;
+  uint16_t is_allocated;
+  uint16_t c;
+
+  if (0 == size)
+  {
+    return 0;
+  }
+
+  if (0 == num_threads)
+  {
+    num_threads = 1;
+  }
+  else if (num_threads > QRS_PARALLEL_MAX_THREADS)
+  {
+    num_threads = QRS_PARALLEL_MAX_THREADS;
+  }
+
+  record.data = data;
+  record.size = size;
+  if (params)
+  {
+    record.params = *params;
+  }
+  else
+  {
+    qrs_params_init(&record.params);
+  }
+
+  record.num_frames = size / record.params.decide_frame_size + 1;
+  record.data_lp = malloc(size * sizeof(uint16_t));
+  record.frame_peaks = malloc(record.num_frames * sizeof(uint16_t));
+  record.thresholds = malloc(record.num_frames * sizeof(uint16_t));
+  is_allocated = record.data_lp && record.frame_peaks && record.thresholds;
+
+  for (c = 0; c < num_threads; ++c)
+  {
+    chunks[c].record = &record;
+    chunks[c].start = (uint64_t)size * c / num_threads;
+    chunks[c].end = (uint64_t)size * (c + 1) / num_threads;
+
+    length = chunks[c].end - chunks[c].start;
+    chunks[c].scratch = malloc((length + QRS_HIGH_PASS_WINDOW_SIZE + QRS_LOW_PASS_WINDOW_SIZE) *
+                               sizeof(uint16_t));
+    chunks[c].beats = malloc((length / (record.params.min_samples_between_beats + 2) + 1) *
+                             sizeof(uint32_t));
+    chunks[c].num_beats = 0;
+    chunks[c].exits = NULL;
+    is_allocated = is_allocated && chunks[c].scratch && chunks[c].beats;
+  }
+
+  count = 0;
+
+  if (is_allocated)
+  {
+    RunChunks(chunks, num_threads, FilterChunk);
+    RunChunks(chunks, num_threads, FindChunkPeaks);
+    StartThresholds(&record);
+
+#if QRS_PARALLEL_SCAN_THRESHOLDS == 1
+    // The scan needs updates that stay in 16 bits to be monotonic, and only
+    // pays off over enough threads and long enough chunks.
+    if (num_threads < QRS_PARALLEL_SCAN_MIN_THREADS ||
+        record.num_frames / num_threads < QRS_PARALLEL_SCAN_MIN_CHUNK_FRAMES ||
+        record.params.alpha_times_gamma + record.params.one_minus_alpha > 1024)
+    {
+      ChainThresholds(&record);
+    }
+    else
+    {
+      is_allocated = ScanThresholds(&record, chunks, num_threads);
+    }
+#else
+    ChainThresholds(&record);
+#endif
+  }
+
+  if (is_allocated)
+  {
+    RunChunks(chunks, num_threads, DetectChunk);
+
+    // The first chunk starts in the same state as a single thread.
+    next_allowed = record.params.min_samples_between_beats + 1;
+    for (c = 0; c < num_threads; ++c)
+    {
+      AppendChunk(&record, &chunks[c], &next_allowed, beats, max_beats, &count);
+    }
+  }
+
+  for (c = 0; c < num_threads; ++c)
+  {
+    free(chunks[c].scratch);
+    free(chunks[c].beats);
+  }
+  free(record.data_lp);
+  free(record.frame_peaks);
+  free(record.thresholds);
+
+  return is_allocated ? (int32_t)count : -1;
+}
@@ -0,0 +1,76 @@
+#ifndef QRS_PARALLEL_H
+#define QRS_PARALLEL_H
+
+#include <stdint.h>
+#include "qrs.h"
+
+// Heartbeat detection of long single-lead records on several threads.
+// The record is split into one chunk per thread. Each chunk is filtered with
+// qrs_long.h from a halo of raw samples before it and high pass outputs after
+// it, so the low pass outputs are the same as filtering the whole record.
+// The thresholds only depend on the peak of each decision frame, so the
+// frame peaks are found per chunk and the thresholds are chained from them
+// on one thread, or scanned over the chunks for very long records (see
+// QRS_PARALLEL_SCAN_THRESHOLDS). Each chunk is then detected as if no
+// heartbeat came just before it, and the start of each chunk is re-run in
+// order until it agrees with the end of the chunk before it. The heartbeats
+// are the same as running the record through one thread (and for records of
+// up to 65535 samples, the same as qrs_get_heartrate).
+
+/**
+  @brief Most threads used by qrs_parallel_detect.
+  */
+#define QRS_PARALLEL_MAX_THREADS 64
+
+/**
+  @brief Set to 1 to allow finding the thresholds of the decision frames
+         with a parallel scan over the chunks. By default they are chained
+         on one thread.
+  @note The scan is only used when alpha * gamma + (1 - alpha) is at most 1,
+        with at least QRS_PARALLEL_SCAN_MIN_THREADS threads and at least
+        QRS_PARALLEL_SCAN_MIN_CHUNK_FRAMES decision frames per chunk.
+  */
+#ifndef QRS_PARALLEL_SCAN_THRESHOLDS
+#define QRS_PARALLEL_SCAN_THRESHOLDS 0
+#endif
+
+/**
+  @brief Fewest threads the scan is used with.
+  @note Measured on a 24 hour record at 360 Hz, the chain takes 2.7 ns per
+        frame and the scan 10 ns per frame over all threads, so fewer than
+        4 threads cannot catch up and 4 barely do.
+  */
+#ifndef QRS_PARALLEL_SCAN_MIN_THREADS
+#define QRS_PARALLEL_SCAN_MIN_THREADS 8
+#endif
+
+/**
+  @brief Fewest decision frames per chunk the scan is used with.
+  @note The scan starts a thread per chunk in each of its three passes, at
+        about 30 us each. With that, the scan on 8 threads only beats the
+        chain from about 56000 frames per chunk (2 ms of chain), and on 64
+        threads from about 36000. Shorter chunks also cost more, since the
+        range of thresholds a chunk can be entered with narrows over a few
+        thousand frames (at 72 frames per chunk the scan was 300 times the
+        chain).
+  */
+#ifndef QRS_PARALLEL_SCAN_MIN_CHUNK_FRAMES
+#define QRS_PARALLEL_SCAN_MIN_CHUNK_FRAMES 60000
+#endif
+
+/**
+  @brief Detect the heartbeats of a long record.
+  @param  data         The raw ECG signal.
+  @param  size         The number of samples.
+  @param  params       The tuning, or NULL for the defaults.
+  @param  num_threads  The number of threads (1 to QRS_PARALLEL_MAX_THREADS).
+  @param  beats        Set to the sample index of each heartbeat.
+  @param  max_beats    The size of beats. Later heartbeats are counted but
+                       not stored.
+  @return The number of heartbeats, or -1 if memory could not be allocated.
+  */
+int32_t qrs_parallel_detect(const uint16_t* data, uint32_t size,
+                            const qrs_params_t* params, uint16_t num_threads,
+                            uint32_t* beats, uint32_t max_beats);
+
+#endif // QRS_PARALLEL_H
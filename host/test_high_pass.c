@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "qrs.h"
+
+// The longest window tested.
+#define MAX_SIZE 3000
+
+// The number of random windows tested.
+#define NUM_RANDOM_WINDOWS 2000
+
+/**
+  @brief Calculate y1[n] by re-adding the whole window, as the high pass
+         filter did before the moving sum.
+  @note The first term is reused if the index would be negative.
+  */
+static uint16_t ReferenceY1(uint16_t n, const uint16_t* data)
+{
+  qrs_hp_sum_t sum;
+  int32_t index;
+  uint16_t m;
+
+  sum = 0;
+
+  for (m = 0; m < QRS_HIGH_PASS_WINDOW_SIZE; ++m)
+  {
+    index = (int32_t)n - m;
+    if (index < 0)
+    {
+      index = 0;
+    }
+
+    sum += data[index];
+  }
+
+  return sum >> QRS_HIGH_PASS_WINDOW_SHIFT;
+}
+
+/**
+  @brief Calculate y2[n], the sample in the middle of the window.
+  */
+static uint16_t ReferenceY2(uint16_t n, const uint16_t* data)
+{
+  int32_t index;
+
+  index = (int32_t)n - (QRS_HIGH_PASS_WINDOW_SIZE + 1) / 2;
+  if (index < 0)
+  {
+    index = 0;
+  }
+
+  return data[index];
+}
+
+/**
+  @brief The O(N * M) high pass filter the moving sum replaced.
+  */
+static void ReferenceHighPass(const uint16_t* data, uint16_t* data_hp, uint16_t size)
+{
+  uint16_t y1_n;
+  uint16_t y2_n;
+  uint16_t n;
+
+  for (n = 0; n < size; ++n)
+  {
+    y1_n = ReferenceY1(n, data);
+    y2_n = ReferenceY2(n, data);
+    data_hp[n] = (y2_n > y1_n) ? y2_n - y1_n : 0;
+  }
+}
+
+/**
+  @brief Compare qrs_filter_high_pass and qrs_filter_high_pass_ring (with
+         the window wrapping around a ring) with the reference.
+  @return 0 if all outputs are the same, otherwise -1 after printing the
+          first difference.
+  */
+static int CheckWindow(const char* name, uint16_t* data, uint16_t size)
+{
+  static uint16_t expected[MAX_SIZE];
+  static uint16_t actual[MAX_SIZE];
+  static uint16_t ring[MAX_SIZE];
+  qrs_ring_view_t view;
+  uint16_t start;
+  uint16_t n;
+
+  ReferenceHighPass(data, expected, size);
+
+  qrs_filter_high_pass(data, actual, size);
+  for (n = 0; n < size; ++n)
+  {
+    if (actual[n] != expected[n])
+    {
+      printf("FAIL %s: size %u, y[%u] = %u, expected %u\n", name, size, n,
+             actual[n], expected[n]);
+      return -1;
+    }
+  }
+
+  // The same window starting part way through a ring.
+  if (size > 0)
+  {
+    start = size / 3;
+    for (n = 0; n < size; ++n)
+    {
+      ring[(start + n) % size] = data[n];
+    }
+
+    view.base = ring;
+    view.packed = NULL;
+    view.capacity = size;
+    view.start = start;
+
+    qrs_filter_high_pass_ring(&view, actual, size);
+    for (n = 0; n < size; ++n)
+    {
+      if (actual[n] != expected[n])
+      {
+        printf("FAIL %s (ring): size %u, y[%u] = %u, expected %u\n", name, size, n,
+               actual[n], expected[n]);
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/**
+  @brief Check the moving sum high pass filter bit for bit against the
+         O(N * M) filter it replaced.
+  @note Covers windows shorter than the filter, the first M outputs where
+        the old filter clamped negative indexes to 0, the full 12-bit range
+        and random windows of random sizes.
+  */
+int main(void)
+{
+  static uint16_t data[MAX_SIZE];
+  uint32_t num_checks;
+  uint16_t size;
+  uint16_t n;
+  int failed;
+  int i;
+
+  srand(1);
+  failed = 0;
+  num_checks = 0;
+
+  // Windows shorter than the filter and just past it, where every output
+  // depends on the clamped first sample.
+  for (size = 0; size <= 2 * QRS_HIGH_PASS_WINDOW_SIZE + 1; ++size)
+  {
+    for (n = 0; n < size; ++n)
+    {
+      data[n] = rand() & 0xFFF;
+    }
+    failed |= CheckWindow("short", data, size);
+
+    // A step right after the first sample.
+    for (n = 0; n < size; ++n)
+    {
+      data[n] = (0 == n) ? 0 : 4095;
+    }
+    failed |= CheckWindow("short step up", data, size);
+
+    for (n = 0; n < size; ++n)
+    {
+      data[n] = (0 == n) ? 4095 : 0;
+    }
+    failed |= CheckWindow("short step down", data, size);
+    num_checks += 3;
+  }
+
+  // The full 12-bit range, where the moving sum of the largest window is
+  // closest to overflowing.
+  for (n = 0; n < MAX_SIZE; ++n)
+  {
+    data[n] = 4095;
+  }
+  failed |= CheckWindow("all 4095", data, MAX_SIZE);
+
+  for (n = 0; n < MAX_SIZE; ++n)
+  {
+    data[n] = (n & 1) ? 4095 : 0;
+  }
+  failed |= CheckWindow("alternating 0 and 4095", data, MAX_SIZE);
+
+  for (n = 0; n < MAX_SIZE; ++n)
+  {
+    data[n] = ((n / QRS_HIGH_PASS_WINDOW_SIZE) & 1) ? 4095 : 0;
+  }
+  failed |= CheckWindow("square wave", data, MAX_SIZE);
+
+  for (n = 0; n < MAX_SIZE; ++n)
+  {
+    data[n] = (rand() & 1) ? 4095 : 0;
+  }
+  failed |= CheckWindow("random rails", data, MAX_SIZE);
+  num_checks += 4;
+
+  // Random windows of random sizes, full range and narrow band.
+  for (i = 0; i < NUM_RANDOM_WINDOWS && !failed; ++i)
+  {
+    size = rand() % (MAX_SIZE + 1);
+    for (n = 0; n < size; ++n)
+    {
+      data[n] = (i & 1) ? (rand() & 0xFFF) : 2048 + rand() % 64 - 32;
+    }
+    failed |= CheckWindow("random", data, size);
+    num_checks++;
+  }
+
+  if (failed)
+  {
+    return 1;
+  }
+
+  printf("PASS high pass at %u Hz: %u windows\n", QRS_SAMPLING_FREQUENCY, num_checks);
+
+  return 0;
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "qrs.h"
+#include "qrs_pipeline.h"
+
+// The longest window tested.
+#define MAX_SIZE 3000
+
+// The number of random windows tested.
+#define NUM_RANDOM_WINDOWS 500
+
+/**
+  @brief A detector stage that records the initial threshold and every low
+         pass output.
+  */
+typedef struct {
+  uint16_t* data_lp;  // Set to the low pass output of each sample.
+  uint16_t threshold; // The initial threshold.
+} RecordStage;
+
+static inline void RecordStageStart(RecordStage* stage, uint16_t threshold)
+{
+  stage->threshold = threshold;
+}
+
+static inline void RecordStageNext(RecordStage* stage, uint16_t lp_n, uint16_t n)
+{
+  stage->data_lp[n] = lp_n;
+}
+
+QRS_PIPELINE_ARRAY_SOURCE(ArraySource)
+QRS_PIPELINE_HIGH_PASS(HighPass, QRS_HIGH_PASS_WINDOW_SHIFT, qrs_hp_sum_t)
+QRS_PIPELINE_MOVING_SUM(SquareLowPass, QRS_HIGH_PASS_WINDOW_SHIFT + 1,
+                        QRS_LOW_PASS_OUTPUT_SHIFT, QRS_PIPELINE_SQUARE)
+QRS_PIPELINE_MOVING_SUM(PlainLowPass, QRS_HIGH_PASS_WINDOW_SHIFT + 1, 0,
+                        QRS_PIPELINE_IDENTITY)
+QRS_PIPELINE(SquarePipeline, ArraySource, HighPass, SquareLowPass, RecordStage)
+QRS_PIPELINE(PlainPipeline, ArraySource, HighPass, PlainLowPass, RecordStage)
+
+/**
+  @brief The moving sum of the high pass output, reusing the last term past
+         the end of the window as qrs_filter_low_pass does.
+  */
+static void ReferencePlainLowPass(const uint16_t* data_hp, uint16_t* data_lp, uint16_t size)
+{
+  uint32_t sum;
+  uint32_t index;
+  uint16_t n;
+  uint16_t m;
+
+  for (n = 0; n < size; ++n)
+  {
+    sum = 0;
+    for (m = 0; m < QRS_LOW_PASS_WINDOW_SIZE; ++m)
+    {
+      index = (uint32_t)n + m;
+      sum += data_hp[(index < size) ? index : size - 1U];
+    }
+
+    data_lp[n] = (sum > 0xFFFF) ? 0xFFFF : sum;
+  }
+}
+
+/**
+  @brief Compare the outputs of a pipeline with the expected outputs.
+  @return 0 if they are the same, otherwise -1 after printing the first
+          difference.
+  */
+static int CompareOutputs(const char* name, const char* pipeline,
+                          const uint16_t* expected, const uint16_t* actual, uint16_t size)
+{
+  uint16_t n;
+
+  for (n = 0; n < size; ++n)
+  {
+    if (actual[n] != expected[n])
+    {
+      printf("FAIL %s (%s): size %u, z[%u] = %u, expected %u\n", name, pipeline, size,
+             n, actual[n], expected[n]);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+  @brief Run both pipelines over a window and compare them with the array
+         filters of qrs.h.
+  @return 0 if all outputs are the same, otherwise -1.
+  */
+static int CheckWindow(const char* name, uint16_t* data, uint16_t size,
+                       uint16_t initial_frame_size)
+{
+  static uint16_t data_hp[MAX_SIZE];
+  static uint16_t expected[MAX_SIZE];
+  static uint16_t actual[MAX_SIZE];
+  SquarePipeline square_pipeline;
+  PlainPipeline plain_pipeline;
+  RecordStage stage;
+  uint16_t threshold;
+  uint16_t n;
+
+  if (0 == size)
+  {
+    return 0;
+  }
+
+  qrs_filter_high_pass(data, data_hp, size);
+  qrs_filter_low_pass(data_hp, expected, size);
+
+  threshold = 0;
+  for (n = 0; n < initial_frame_size && n < size; ++n)
+  {
+    if (expected[n] > threshold)
+    {
+      threshold = expected[n];
+    }
+  }
+
+  // The stage must set the threshold to pass.
+  stage.data_lp = actual;
+  stage.threshold = ~threshold;
+  SquarePipelineRun(&square_pipeline, data, &stage, initial_frame_size, size);
+  if (CompareOutputs(name, "square", expected, actual, size))
+  {
+    return -1;
+  }
+
+  if (stage.threshold != threshold)
+  {
+    printf("FAIL %s (square): size %u, threshold %u, expected %u\n", name, size,
+           stage.threshold, threshold);
+    return -1;
+  }
+
+  ReferencePlainLowPass(data_hp, expected, size);
+  PlainPipelineRun(&plain_pipeline, data, &stage, initial_frame_size, size);
+
+  return CompareOutputs(name, "plain", expected, actual, size);
+}
+
+/**
+  @brief Check pipelines composed from the stage templates, with an array
+         source, against the array filters of qrs.h.
+  @note The squared pipeline must match qrs_filter_high_pass and
+        qrs_filter_low_pass bit for bit, with the same initial threshold as
+        the peak of the first frame. The plain moving sum pipeline checks
+        swapping the low pass stage. Covers windows shorter than the
+        filters, the full 12-bit range and random windows.
+  */
+int main(void)
+{
+  static uint16_t data[MAX_SIZE];
+  qrs_params_t params;
+  uint32_t num_checks;
+  uint16_t size;
+  uint16_t n;
+  int failed;
+  int i;
+
+  srand(1);
+  qrs_params_init(&params);
+  failed = 0;
+  num_checks = 0;
+
+  // Windows shorter than the filters and just past them, where the outputs
+  // depend on the padding at both ends.
+  for (size = 0; size <= 2 * QRS_LOW_PASS_WINDOW_SIZE + 1; ++size)
+  {
+    for (n = 0; n < size; ++n)
+    {
+      data[n] = rand() & 0xFFF;
+    }
+    failed |= CheckWindow("short", data, size, params.initial_frame_size);
+    num_checks++;
+  }
+
+  // The full 12-bit range, where the squared sums saturate.
+  for (n = 0; n < MAX_SIZE; ++n)
+  {
+    data[n] = (n & 1) ? 4095 : 0;
+  }
+  failed |= CheckWindow("alternating 0 and 4095", data, MAX_SIZE, params.initial_frame_size);
+
+  for (n = 0; n < MAX_SIZE; ++n)
+  {
+    data[n] = ((n / QRS_LOW_PASS_WINDOW_SIZE) & 1) ? 4095 : 0;
+  }
+  failed |= CheckWindow("square wave", data, MAX_SIZE, params.initial_frame_size);
+
+  for (n = 0; n < MAX_SIZE; ++n)
+  {
+    data[n] = (rand() & 1) ? 4095 : 0;
+  }
+  failed |= CheckWindow("random rails", data, MAX_SIZE, params.initial_frame_size);
+  num_checks += 3;
+
+  // Random windows of random sizes and initial frames, full range and
+  // narrow band.
+  for (i = 0; i < NUM_RANDOM_WINDOWS && !failed; ++i)
+  {
+    size = rand() % (MAX_SIZE + 1);
+    for (n = 0; n < size; ++n)
+    {
+      data[n] = (i & 1) ? (rand() & 0xFFF) : 2048 + rand() % 64 - 32;
+    }
+    failed |= CheckWindow("random", data, size, rand() % (MAX_SIZE + 1));
+    num_checks++;
+  }
+
+  if (failed)
+  {
+    return 1;
+  }
+
+  printf("PASS pipeline at %u Hz: %u windows\n", QRS_SAMPLING_FREQUENCY, num_checks);
+
+  return 0;
+}
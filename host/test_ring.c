@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "ring.h"
+
+// The window read by the consumer and the slack of the ring beyond it. The
+// slack is small so the producer often overruns the window being read.
+#define WINDOW_SIZE 250
+#define SLACK 8
+#define CAPACITY (WINDOW_SIZE + SLACK)
+
+// The number of samples the producer writes.
+#define NUM_SAMPLES 20000000
+
+/**
+  @brief The ring under test and the consumer's results.
+  */
+typedef struct {
+  ring_t ring;
+  volatile uint16_t is_done; // Set by the producer after its last sample.
+  uint32_t num_intact;       // Windows reported intact.
+  uint32_t num_overrun;      // Windows reported overwritten.
+  uint32_t num_failures;     // Intact windows that were not contiguous.
+} Test;
+
+/**
+  @brief The sample of write i: a 12-bit counter.
+  */
+static inline uint16_t SampleOf(uint32_t i)
+{
+  return i & 0xFFF;
+}
+
+/**
+  @brief Read sample i of the ring storage.
+  @note Sample i of a packed ring starts at byte i + i / 2.
+  */
+static uint16_t ReadSample(const ring_t* ring, uint16_t index)
+{
+  const volatile uint8_t* packed;
+
+  if (NULL == ring->packed)
+  {
+    return ring->data[index];
+  }
+
+  packed = ring->packed + index + (index >> 1);
+
+  if (index & 1)
+  {
+    return (packed[0] >> 4) | ((uint16_t)packed[1] << 4);
+  }
+
+  return packed[0] | ((uint16_t)(packed[1] & 0x0F) << 8);
+}
+
+/**
+  @brief Push the counter into the ring as fast as possible.
+  */
+static void* Produce(void* argument)
+{
+  Test* test;
+  uint32_t i;
+
+  test = argument;
+
+  // The ring was filled once before the consumer started.
+  for (i = CAPACITY; i < NUM_SAMPLES; ++i)
+  {
+    ring_push(&test->ring, SampleOf(i));
+  }
+
+  __atomic_store_n(&test->is_done, 1, __ATOMIC_RELEASE);
+
+  return NULL;
+}
+
+/**
+  @brief Read the latest window over and over, as the main loop does, and
+         check every window reported intact.
+  @note An intact window must hold consecutive counter values (no sample
+        out of order, missing or torn) that end at or after the write count
+        taken when the window was located.
+  */
+static void Consume(Test* test)
+{
+  static uint16_t window[WINDOW_SIZE];
+  uint16_t count;
+  uint16_t start;
+  uint16_t index;
+  uint16_t i;
+
+  while (!__atomic_load_n(&test->is_done, __ATOMIC_ACQUIRE))
+  {
+    count = ring_get_window(&test->ring, WINDOW_SIZE, &start);
+
+    index = start;
+    for (i = 0; i < WINDOW_SIZE; ++i)
+    {
+      window[i] = ReadSample(&test->ring, index);
+      if (++index == CAPACITY)
+      {
+        index = 0;
+      }
+    }
+
+    if (!ring_is_window_intact(&test->ring, WINDOW_SIZE, count))
+    {
+      test->num_overrun++;
+      continue;
+    }
+
+    test->num_intact++;
+
+    for (i = 1; i < WINDOW_SIZE; ++i)
+    {
+      if (window[i] != SampleOf(window[i - 1] + 1))
+      {
+        break;
+      }
+    }
+
+    // The window ends at the head, which is at or after the count and within
+    // the slack of it.
+    if (i < WINDOW_SIZE || SampleOf(window[WINDOW_SIZE - 1] + 1 - count) >= SLACK)
+    {
+      if (test->num_failures++ < 5)
+      {
+        printf("FAIL %s ring: window at count %u not contiguous at %u (%u, %u)\n",
+               (NULL == test->ring.packed) ? "plain" : "packed", count, i,
+               window[i - (i == WINDOW_SIZE)], window[WINDOW_SIZE - 1]);
+      }
+    }
+  }
+}
+
+/**
+  @brief Run the producer on its own thread against the consumer.
+  @return 0 if every intact window was contiguous, otherwise -1.
+  */
+static int RunTest(Test* test, const char* name)
+{
+  pthread_t producer;
+  uint32_t i;
+
+  for (i = 0; i < CAPACITY; ++i)
+  {
+    ring_push(&test->ring, SampleOf(i));
+  }
+
+  test->is_done = 0;
+  test->num_intact = 0;
+  test->num_overrun = 0;
+  test->num_failures = 0;
+
+  if (pthread_create(&producer, NULL, Produce, test))
+  {
+    perror("pthread_create");
+    return -1;
+  }
+
+  Consume(test);
+  pthread_join(producer, NULL);
+
+  // Without overruns the check of the slack was never exercised.
+  if (test->num_failures || 0 == test->num_intact || 0 == test->num_overrun)
+  {
+    printf("FAIL %s ring: %u of %u intact windows bad, %u overruns\n", name,
+           test->num_failures, test->num_intact, test->num_overrun);
+    return -1;
+  }
+
+  printf("PASS %s ring: %u intact windows, %u overruns\n", name,
+         test->num_intact, test->num_overrun);
+
+  return 0;
+}
+
+/**
+  @brief Stress the ring with a producer and a consumer on two threads.
+  @note The producer writes a counter. The consumer checks that every window
+        ring_is_window_intact accepts is in order with no gaps, for the
+        plain and the packed ring. Some windows must be rejected too.
+  */
+int main(void)
+{
+  static uint16_t data[CAPACITY];
+  static uint8_t packed[RING_PACKED_SIZE(CAPACITY)];
+  static Test test;
+  int failed;
+
+  ring_init(&test.ring, data, CAPACITY, 0);
+  failed = RunTest(&test, "plain");
+
+  ring_init_packed(&test.ring, packed, CAPACITY, 0);
+  failed |= RunTest(&test, "packed");
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "codec.h"
+#include "trace.h"
+
+/**
+  @brief The names of the traced stages, used as the CSV stage column.
+  */
+static const char* const kStageNames[kTraceNumStages] = {
+  "original",
+  "high_pass",
+  "low_pass",
+  "qrs",
+  "recording"
+};
+
+/**
+  @brief Read a little-endian 16-bit word.
+  @return The word or -1 at the end of the file.
+  */
+static long ReadWord(FILE* file)
+{
+  int low;
+  int high;
+
+  low = fgetc(file);
+  high = fgetc(file);
+  if (EOF == low || EOF == high)
+  {
+    return -1;
+  }
+
+  return low | (high << 8);
+}
+
+/**
+  @brief Find the next frame by its magic number.
+  @return 0 once the magic number has been read, otherwise -1 at the end of
+          the file.
+  */
+static int FindFrame(FILE* file)
+{
+  int previous;
+  int c;
+
+  previous = EOF;
+  while (EOF != (c = fgetc(file)))
+  {
+    if ((TRACE_MAGIC & 0xFF) == previous && (TRACE_MAGIC >> 8) == c)
+    {
+      return 0;
+    }
+    previous = c;
+  }
+
+  return -1;
+}
+
+/**
+  @brief Decode a binary trace (see trace.h) into CSV.
+  @note Writes frame,stage,index,value rows to stdout. Frames with a bad
+        checksum or an unknown stage are reported on stderr and skipped.
+  */
+int main(int argc, char** argv)
+{
+  FILE* file;
+  uint16_t* samples;
+  uint16_t decoded[CODEC_BLOCK_SIZE];
+  uint16_t num_decoded;
+  long header[3];
+  long word;
+  uint16_t sum;
+  uint16_t size;
+  uint32_t num_frames;
+  uint32_t num_bad_frames;
+  uint16_t i;
+  uint16_t j;
+
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s <trace_file>\n", argv[0]);
+    return 1;
+  }
+
+  file = fopen(argv[1], "rb");
+  if (NULL == file)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  samples = malloc(0x10000 * sizeof(uint16_t));
+  num_frames = 0;
+  num_bad_frames = 0;
+
+  printf("frame,stage,index,value\n");
+
+  while (0 == FindFrame(file))
+  {
+    for (i = 0; i < 3; ++i)
+    {
+      header[i] = ReadWord(file);
+    }
+    if (header[2] < 0)
+    {
+      break;
+    }
+
+    size = header[2];
+    sum = header[0] + header[1] + header[2];
+    for (i = 0; i < size; ++i)
+    {
+      word = ReadWord(file);
+      if (word < 0)
+      {
+        break;
+      }
+      samples[i] = word;
+      sum += samples[i];
+    }
+    if (i < size)
+    {
+      fprintf(stderr, "frame %ld: truncated\n", header[1]);
+      num_bad_frames++;
+      break;
+    }
+
+    word = ReadWord(file);
+    if (word != sum || header[0] >= kTraceNumStages)
+    {
+      // Resynchronize from just after the bad frame's magic number.
+      fprintf(stderr, "frame %ld: bad checksum or stage\n", header[1]);
+      fseek(file, -(long)(2 * size + 8), SEEK_CUR);
+      num_bad_frames++;
+      continue;
+    }
+
+    if (kTraceStageRecording == header[0])
+    {
+      // The words hold a compressed block of samples.
+      if (0 == codec_decode_block((const uint8_t*)samples, size * sizeof(uint16_t),
+                                  decoded, CODEC_BLOCK_SIZE, &num_decoded))
+      {
+        fprintf(stderr, "frame %ld: bad recording block\n", header[1]);
+        num_bad_frames++;
+        continue;
+      }
+      for (j = 0; j < num_decoded; ++j)
+      {
+        printf("%ld,%s,%u,%u\n", header[1], kStageNames[header[0]], j, decoded[j]);
+      }
+    }
+    else
+    {
+      for (j = 0; j < size; ++j)
+      {
+        printf("%ld,%s,%u,%u\n", header[1], kStageNames[header[0]], j, samples[j]);
+      }
+    }
+    num_frames++;
+  }
+
+  fprintf(stderr, "%u frames, %u bad\n", num_frames, num_bad_frames);
+
+  free(samples);
+  fclose(file);
+
+  return 0;
+}
@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wfdb.h"
+
+// The longest header line and signal file path that are read.
+#define MAX_LINE_SIZE 1024
+
+/**
+  @brief The bytes of read samples gathered before they are released.
+  */
+static const size_t kReleaseSize = 1 << 20;
+
+/**
+  @brief The fields of a signal line of a header that the reader uses.
+  */
+typedef struct {
+  char file[MAX_LINE_SIZE]; // The name of the signal file.
+  long format;              // The storage format.
+  long samples_per_frame;   // The samples of the signal in each frame.
+  long offset;              // The byte offset of the first sample.
+  long adc_resolution;      // The bits of each sample.
+  long adc_zero;            // The sample value of 0 V.
+} SignalLine;
+
+/**
+  @brief Read the next line of a header that is not blank or a comment.
+  @return line, or NULL at the end of the file.
+  */
+static char* ReadLine(FILE* file, char* line)
+{
+  char* start;
+
+  while (fgets(line, MAX_LINE_SIZE, file))
+  {
+    start = line + strspn(line, " \t\r\n");
+    if ('\0' != *start && '#' != *start)
+    {
+      return start;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  @brief Parse a signal line: file, format[xN][:skew][+offset], gain,
+         ADC resolution, ADC zero and fields that are not used.
+  @return 0 on success, otherwise -1.
+  */
+static int ParseSignalLine(char* text, SignalLine* signal)
+{
+  char* token;
+  char* end;
+
+  token = strtok(text, " \t\r\n");
+  if (NULL == token || strlen(token) >= MAX_LINE_SIZE)
+  {
+    return -1;
+  }
+  strcpy(signal->file, token);
+
+  token = strtok(NULL, " \t\r\n");
+  if (NULL == token)
+  {
+    return -1;
+  }
+
+  signal->format = strtol(token, &end, 10);
+  signal->samples_per_frame = 1;
+  signal->offset = 0;
+  while ('\0' != *end)
+  {
+    switch (*end++)
+    {
+      case 'x':
+        signal->samples_per_frame = strtol(end, &end, 10);
+        break;
+      case ':':
+        strtol(end, &end, 10);
+        break;
+      case '+':
+        signal->offset = strtol(end, &end, 10);
+        break;
+      default:
+        return -1;
+    }
+  }
+
+  // The gain is skipped. The resolution and zero default by format.
+  signal->adc_resolution = (212 == signal->format) ? 12 : 16;
+  signal->adc_zero = 0;
+  if (NULL != strtok(NULL, " \t\r\n"))
+  {
+    token = strtok(NULL, " \t\r\n");
+    if (NULL != token)
+    {
+      if (0 != strtol(token, NULL, 10))
+      {
+        signal->adc_resolution = strtol(token, NULL, 10);
+      }
+      token = strtok(NULL, " \t\r\n");
+      if (NULL != token)
+      {
+        signal->adc_zero = strtol(token, NULL, 10);
+      }
+    }
+  }
+
+  return 0;
+}
+
+/**
+  @brief Map the signal file of a record.
+  @param  record  The record, with offset set.
+  @param  header  The path of the header file.
+  @param  file    The name of the signal file, relative to the header.
+  @return 0 on success, otherwise -1 after printing the reason.
+  */
+static int MapSignalFile(wfdb_record_t* record, const char* header, const char* file)
+{
+  char path[2 * MAX_LINE_SIZE];
+  const char* slash;
+  struct stat status;
+  void* map;
+  int descriptor;
+
+  slash = strrchr(header, '/');
+  if (NULL != slash && '/' != file[0] && slash - header < MAX_LINE_SIZE)
+  {
+    snprintf(path, sizeof(path), "%.*s/%s", (int)(slash - header), header, file);
+  }
+  else
+  {
+    snprintf(path, sizeof(path), "%s", file);
+  }
+
+  descriptor = open(path, O_RDONLY);
+  if (descriptor < 0)
+  {
+    perror(path);
+    return -1;
+  }
+
+  if (fstat(descriptor, &status) || (size_t)status.st_size <= record->offset)
+  {
+    fprintf(stderr, "%s: no samples\n", path);
+    close(descriptor);
+    return -1;
+  }
+
+  map = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  close(descriptor);
+  if (MAP_FAILED == map)
+  {
+    perror(path);
+    return -1;
+  }
+
+  // The file is read front to back once.
+  madvise(map, status.st_size, MADV_SEQUENTIAL);
+
+  record->map = map;
+  record->map_size = status.st_size;
+
+  return 0;
+}
+
+int wfdb_open(wfdb_record_t* record, const char* header, uint16_t signal)
+{
+  char line[MAX_LINE_SIZE];
+  char** files;
+  SignalLine signal_line;
+  SignalLine chosen;
+  FILE* file;
+  char* text;
+  char* name;
+  long num_signals;
+  long num_samples;
+  double frequency;
+  size_t available;
+  long i;
+  int result;
+
+  record->map = NULL;
+
+  file = fopen(header, "r");
+  if (NULL == file)
+  {
+    perror(header);
+    return -1;
+  }
+
+  // The record line: name[/segments] signals [frequency [samples]].
+  text = ReadLine(file, line);
+  name = text ? strtok(text, " \t\r\n") : NULL;
+  text = name ? strtok(NULL, " \t\r\n") : NULL;
+  if (NULL == text || NULL != strchr(name, '/'))
+  {
+    fprintf(stderr, "%s: not a single segment record\n", header);
+    fclose(file);
+    return -1;
+  }
+  num_signals = strtol(text, NULL, 10);
+  text = strtok(NULL, " \t\r\n");
+  frequency = text ? strtod(text, NULL) : 250;
+  text = text ? strtok(NULL, " \t\r\n") : NULL;
+  num_samples = text ? strtol(text, NULL, 10) : 0;
+
+  if (signal >= num_signals)
+  {
+    fprintf(stderr, "%s: no signal %u\n", header, signal);
+    fclose(file);
+    return -1;
+  }
+
+  // Find the signal and the signals interleaved with it in its file.
+  files = calloc(num_signals, sizeof(char*));
+  if (NULL == files)
+  {
+    fprintf(stderr, "%s: out of memory for %ld signals\n", header, num_signals);
+    fclose(file);
+    return -1;
+  }
+
+  result = 0;
+  for (i = 0; i < num_signals && 0 == result; ++i)
+  {
+    text = ReadLine(file, line);
+    if (NULL == text || ParseSignalLine(text, &signal_line))
+    {
+      fprintf(stderr, "%s: bad signal line %ld\n", header, i);
+      result = -1;
+      break;
+    }
+
+    files[i] = strdup(signal_line.file);
+    if (NULL == files[i])
+    {
+      fprintf(stderr, "%s: out of memory for signal line %ld\n", header, i);
+      result = -1;
+      break;
+    }
+
+    if (i == signal)
+    {
+      chosen = signal_line;
+    }
+  }
+  fclose(file);
+
+  if (0 == result)
+  {
+    record->num_signals = 0;
+    record->index = 0;
+    for (i = 0; i < num_signals; ++i)
+    {
+      if (0 == strcmp(files[i], chosen.file))
+      {
+        if (i == signal)
+        {
+          record->index = record->num_signals;
+        }
+        record->num_signals++;
+      }
+    }
+
+    if ((212 != chosen.format && 16 != chosen.format) || 1 != chosen.samples_per_frame)
+    {
+      fprintf(stderr, "%s: format %ldx%ld is not supported\n", header,
+              chosen.format, chosen.samples_per_frame);
+      result = -1;
+    }
+  }
+
+  for (i = 0; i < num_signals; ++i)
+  {
+    free(files[i]);
+  }
+  free(files);
+
+  if (0 != result)
+  {
+    return -1;
+  }
+
+  record->format = chosen.format;
+  record->offset = chosen.offset;
+  record->released = 0;
+  record->shift_up = (chosen.adc_resolution < 12) ? 12 - chosen.adc_resolution : 0;
+  record->shift_down = (chosen.adc_resolution > 12) ? chosen.adc_resolution - 12 : 0;
+  record->adc_zero = chosen.adc_zero;
+  record->frequency = frequency + 0.5;
+  record->position = 0;
+
+  if (MapSignalFile(record, header, chosen.file))
+  {
+    return -1;
+  }
+
+  // Trust the file over the header if it is short.
+  available = record->map_size - record->offset;
+  available = (212 == record->format) ? available / 3 * 2 : available / 2;
+  available /= record->num_signals;
+  record->num_samples = (num_samples > 0 && (size_t)num_samples < available) ?
+                        (uint32_t)num_samples : available;
+
+  return 0;
+}
+
+/**
+  @brief Convert a sample to the unsigned 12-bit ADC range.
+  */
+static inline uint16_t ToAdc(const wfdb_record_t* record, int32_t sample)
+{
+  int32_t value;
+
+  value = (sample - record->adc_zero) * (1 << record->shift_up) + (2048 << record->shift_down);
+  if (value < 0)
+  {
+    return 0;
+  }
+
+  value >>= record->shift_down;
+
+  return (value > 4095) ? 4095 : value;
+}
+
+/**
+  @brief Release the pages of the mapping before a byte that has been read.
+  */
+static void ReleasePages(wfdb_record_t* record, size_t byte)
+{
+  size_t page_size;
+
+  page_size = sysconf(_SC_PAGESIZE);
+  byte &= ~(page_size - 1);
+
+  if (byte >= record->released + kReleaseSize)
+  {
+    madvise((uint8_t*)record->map + record->released, byte - record->released,
+            MADV_DONTNEED);
+    record->released = byte;
+  }
+}
+
+uint32_t wfdb_read(wfdb_record_t* record, uint16_t* data, uint32_t size)
+{
+  const uint8_t* samples;
+  const uint8_t* pair;
+  uint64_t m;
+  int32_t sample;
+  uint32_t i;
+
+  if (record->position >= record->num_samples)
+  {
+    return 0;
+  }
+
+  if (size > record->num_samples - record->position)
+  {
+    size = record->num_samples - record->position;
+  }
+
+  // m is the index of the sample among the interleaved samples of the file.
+  samples = record->map + record->offset;
+  m = (uint64_t)record->position * record->num_signals + record->index;
+
+  if (212 == record->format)
+  {
+    // Each pair of samples is 3 bytes: the low byte of the first, the high
+    // nibbles of both (the second's on top) and the low byte of the second.
+    for (i = 0; i < size; ++i)
+    {
+      pair = samples + (m >> 1) * 3;
+      if (m & 1)
+      {
+        sample = pair[2] | ((pair[1] & 0xF0) << 4);
+      }
+      else
+      {
+        sample = pair[0] | ((pair[1] & 0x0F) << 8);
+      }
+
+      // Sign extend from 12 bits.
+      data[i] = ToAdc(record, (sample ^ 0x800) - 0x800);
+      m += record->num_signals;
+    }
+
+    ReleasePages(record, record->offset + (m >> 1) * 3);
+  }
+  else
+  {
+    for (i = 0; i < size; ++i)
+    {
+      sample = (int16_t)(samples[2 * m] | (samples[2 * m + 1] << 8));
+      data[i] = ToAdc(record, sample);
+      m += record->num_signals;
+    }
+
+    ReleasePages(record, record->offset + 2 * m);
+  }
+
+  record->position += size;
+
+  return size;
+}
+
+void wfdb_seek(wfdb_record_t* record, uint32_t position)
+{
+  record->position = (position < record->num_samples) ? position : record->num_samples;
+  record->released = 0;
+}
+
+void wfdb_close(wfdb_record_t* record)
+{
+  if (NULL != record->map)
+  {
+    munmap((void*)record->map, record->map_size);
+    record->map = NULL;
+  }
+}
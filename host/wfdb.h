@@ -0,0 +1,69 @@
+#ifndef WFDB_H
+#define WFDB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Reader of PhysioNet WFDB records (such as the MIT-BIH Arrhythmia Database)
+// for the host tools. The header (.hea) is parsed for one signal and its
+// signal file (.dat) is memory-mapped read-only. Samples are decoded straight
+// from the mapping into the caller's uint16_t array in the unsigned 12-bit
+// layout of the ADC that qrs.h expects: the ADC zero is moved to 2048 and
+// the samples are shifted to 12 bits (the 11-bit MIT-BIH samples up by one).
+// Pages already read are released, so a record of any length is streamed in
+// constant memory.
+// Formats 212 (two 12-bit samples in 3 bytes) and 16 (16-bit little-endian)
+// are supported, with any number of signals interleaved in a file.
+
+/**
+  @brief An open signal of a WFDB record.
+  */
+typedef struct {
+  const uint8_t* map;    // The mapped signal file.
+  size_t map_size;       // The size of the mapping in bytes.
+  size_t offset;         // The byte offset of the first sample.
+  size_t released;       // The bytes of the mapping already released.
+  uint16_t format;       // 212 or 16.
+  uint16_t num_signals;  // The number of signals interleaved in the file.
+  uint16_t index;        // The index of the signal in the file.
+  uint16_t shift_up;     // The left shift of fewer than 12 bits to 12.
+  uint16_t shift_down;   // The right shift of more than 12 bits to 12.
+  int32_t adc_zero;      // The sample value of 0 V.
+  uint32_t frequency;    // The sampling frequency in Hz.
+  uint32_t num_samples;  // The number of samples of the signal.
+  uint32_t position;     // The index of the next sample read.
+} wfdb_record_t;
+
+/**
+  @brief Open a signal of a WFDB record.
+  @param  record  The record.
+  @param  header  The path of the header file (e.g. "mitdb/100.hea").
+  @param  signal  The index of the signal in the header (0 for the first).
+  @return 0 on success, otherwise -1 after printing the reason.
+  @note The signal file is found next to the header.
+  */
+int wfdb_open(wfdb_record_t* record, const char* header, uint16_t signal);
+
+/**
+  @brief Decode the next samples of the signal.
+  @param  record  The record.
+  @param  data    Set to the samples (0 to 4095).
+  @param  size    The most samples to decode.
+  @return The number of samples decoded, 0 at the end of the record.
+  */
+uint32_t wfdb_read(wfdb_record_t* record, uint16_t* data, uint32_t size);
+
+/**
+  @brief Move to a sample of the signal.
+  @param  record    The record.
+  @param  position  The index of the next sample read.
+  */
+void wfdb_seek(wfdb_record_t* record, uint32_t position);
+
+/**
+  @brief Close the record.
+  @param  record  The record.
+  */
+void wfdb_close(wfdb_record_t* record);
+
+#endif // WFDB_H
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "qrs.h"
+#include "wfdb.h"
+
+// The number of samples decoded at a time.
+#define BLOCK_SIZE 4096
+
+/**
+  @brief The delay from the QRS to its streaming detection.
+  @note The threshold is crossed as the QRS enters the low pass window, and
+        the high pass output lags the raw signal by half its window.
+  */
+static const uint32_t kStreamDelay = QRS_HIGH_PASS_WINDOW_SIZE / 2;
+
+/**
+  @brief Stream a signal of a WFDB record through the streaming detector and
+         print the sample index of each heartbeat, one per line.
+  @note The index is that of the QRS, the detection less kStreamDelay, so it
+        can be compared with the record's annotations as qrs_bench does.
+        Build with -DQRS_SAMPLING_FREQUENCY set to the record's frequency
+        (e.g. 360 for the MIT-BIH Arrhythmia Database).
+  */
+int main(int argc, char** argv)
+{
+  static uint16_t block[BLOCK_SIZE];
+  wfdb_record_t record;
+  qrs_stream_t stream;
+  uint32_t position;
+  uint32_t size;
+  uint32_t num_beats;
+  uint32_t i;
+
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s <record.hea> [signal]\n", argv[0]);
+    return 1;
+  }
+
+  if (wfdb_open(&record, argv[1], (argc > 2) ? atoi(argv[2]) : 0))
+  {
+    return 1;
+  }
+
+  if (QRS_SAMPLING_FREQUENCY != record.frequency)
+  {
+    fprintf(stderr, "%s: %u Hz, but built for %u Hz (-DQRS_SAMPLING_FREQUENCY)\n",
+            argv[1], record.frequency, QRS_SAMPLING_FREQUENCY);
+  }
+
+  qrs_stream_init(&stream, NULL);
+  position = 0;
+  num_beats = 0;
+
+  while (0 != (size = wfdb_read(&record, block, BLOCK_SIZE)))
+  {
+    for (i = 0; i < size; ++i)
+    {
+      if (qrs_stream_push(&stream, block[i]))
+      {
+        printf("%u\n", position + i - kStreamDelay);
+        num_beats++;
+      }
+    }
+    position += size;
+  }
+
+  fprintf(stderr, "%u samples, %u heartbeats\n", position, num_beats);
+
+  wfdb_close(&record);
+
+  return 0;
+}
@@ -1,119 +1,110 @@
-#include <msp430.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include "fastdiv.h"
+#include "hal.h"
 #include "main.h"
 #include "printf.h"
 #include "qrs.h"
+#include "trace.h"
 
-/**
-  @brief Disables the USB component.
-  */
-static void disable_usb(void)
-{
-  USBKEYPID = USBKEY;    // Enable access to USB config registers.
-  USBPWRCTL &= ~VUSBEN;  // Disable the VUSB LDO.
-  USBPWRCTL &= ~SLDOEN;  // Disable the VUSB SLDO.
-  USBKEYPID = 0x9600;    // Disable access to USB config registers.
-}
+// The current state.
+static state_t state = kStateIdle;
 
-/**
-  @brief Initializes the ADC converter.
-  */
-static void init_adc(void)
-{
-  P7DIR &= ~BIT0;                 // Set P7.0 as input.
-  P7SEL |= BIT0;                  // ADC option select A12 (P7.0).
-
-  ADC12CTL0 = ADC12SHT02 |        // 64 CLK cycles sampling time.
-              ADC12ON;            // ADC12 on.
-  ADC12CTL1 = ADC12CSTARTADD_0 |  // ADC12 Conversion Start Address 0.
-              ADC12SSEL_3      |  // SMCLK.
-              ADC12SHP;           // Sample/Hold Pulse Mode.
-  ADC12MCTL0 = ADC12INCH_12;      // Use A12 (P7.0) as input
-
-  ADC12IE = ADC12IE0;             // Enable interrupt on ADC12IE0.
-  ADC12CTL0 |= ADC12ENC;          // Enable conversion.
-}
+#if STREAM_QRS_DETECTION == 0 || TEST_SAMPLE == 1
+// Ring over the sample array in main. The sample array is not global
+// because if it is then the CPU will hang on init_zero.
+static ring_t sample_ring;
+#endif
 
-/**
-  @brief Initializes the timer that changes state to start processing ECG.
-  */
-static void init_detector_timer(void)
-{
-  TA0CCR0 = (32768 >> 3) * QRS_DETECTING_PERIOD;
+// The streaming QRS detector fed by the ADC interrupt.
+static qrs_stream_t qrs_stream;
 
-  TA0CTL = TASSEL_1 |  // ACLK (32768 Hz)
-           ID_3     |  // Clock divider. Divide by 8 (2^3).
-           MC_1     |  // Up to TA0CCR0.
-           TACLR;      // Clear timer.
+#if ENABLE_RECORDING == 1
+// Two blocks of compressed samples. The ADC interrupt encodes into one while
+// the main loop sends the other.
+static uint16_t record_blocks[2][(CODEC_MAX_BLOCK_BYTES(CODEC_BLOCK_SIZE) + 1) / 2];
 
-  TA0CCTL0 = CCIE;     // Enable interrupt on TA0CCR0.
-}
+// The encoder of the block the ADC interrupt writes.
+static codec_encoder_t record_encoder;
 
-/**
-  @brief Initializes the pins used to drive the display.
-  */
-static void init_display_driver(void)
-{
-  // Set pins to output direction.
-  P4DIR |= 0x01;  // P4.0.
-  P3DIR |= 0x7F;  // P3.0 to  P3.6 (First Digit).
-  P6DIR |= 0x7F;  // P6.0 to  P6.6 (Second Digit).
-  P2DIR |= 0x05;  // P2.0 and P2.2 (Third Digit).
-}
+// The index in record_blocks of the block being encoded.
+static uint16_t record_block_index;
 
-/**
-  @brief Initializes the timer used to refresh the display.
-  */
-static void init_display_timer(void)
-{
-  TA2CCR0 = (32768 >> 3) / DISPLAY_REFRESH_FREQUENCY;
+// The size in bytes of the other block if it is waiting to be sent, or 0.
+static volatile uint16_t record_block_size;
 
-  TA2CTL = TASSEL_1 |  // ACLK (32768 Hz)
-           ID_3     |  // Clock divider. Divide by 8 (2^3).
-           MC_1     |  // Up to TA2CCR0.
-           TACLR;      // Clear timer.
+// The number of blocks dropped because the other block was still being sent.
+static uint16_t num_dropped_record_blocks;
+#endif
 
-  TA2CCTL0 = CCIE;     // Enable interrupt on TA2CCR0.
-}
+#if ENABLE_PROFILING == 1
+// The cycle counts of each stage. Read them with the debugger.
+static profile_t profile;
+#endif
 
+#if STREAM_QRS_DETECTION == 0 && ENABLE_LOGGING == 1
 /**
-  @brief Initializes the timer that does the sampling.
-  @notes ECG has a bandwidth up to 150 Hz.
-         Spectrum analysis shows that the majority of the component in below 30 Hz.
+  @brief Logs the array for a step of the QRS detection.
+  @note With ENABLE_TRACE the array is sent as one binary frame instead of
+        being printed one number at a time.
   */
-static void init_sampler_timer(void)
+static void log_qrs_step(trace_stage_t stage, char* step, uint16_t* array, size_t size)
 {
-#if TEST_SAMPLE == 0
-  TA1CCR0 = (32768 >> 3) / SAMPLING_FREQUENCY;
+#if ENABLE_TRACE == 1
+  trace_write(stage, array, size);
+#else
+  size_t idx;
 
-  TA1CTL = TASSEL_1 |  // ACLK (32768 Hz)
-           ID_3     |  // Clock divider. Divide by 8 (2^3).
-           MC_1     |  // Up to TA1CCR0.
-           TACLR;      // Clear timer.
+  printf(step);
+  printf("\n");
 
-  TA1CCTL0 = CCIE;     // Enable interrupt on TA1CCR0.
+  for (idx = 0; idx < size; idx++)
+  {
+    printf("%u\n", array[idx]);
+  }
 #endif
 }
+#endif
 
+#if STREAM_QRS_DETECTION == 1
 /**
-  @brief Logs the array for a step of the QRS detection.
+  @brief Logs the heart rate and heart rate variability of the stream.
   */
-static void log_qrs_step(char* step, uint16_t* array, size_t size)
+static void log_qrs_hrv(const qrs_hrv_t* hrv)
 {
 #if ENABLE_LOGGING == 1
-  size_t idx;
+  printf("HR %u SDNN %u RMSSD %u pNN50 %u\n",
+         qrs_hrv_get_heartrate(hrv),
+         qrs_hrv_get_sdnn(hrv),
+         qrs_hrv_get_rmssd(hrv),
+         qrs_hrv_get_pnn50(hrv));
+#endif
+}
+#endif
 
-  printf(step);
-  printf("\n");
+/**
+  @brief Logs the cycle counts of each stage of the detector.
+  */
+static void log_profile(void)
+{
+#if ENABLE_LOGGING == 1 && ENABLE_PROFILING == 1
+  static const char* const stage_names[kProfileNumStages] = {
+    "high pass", "low pass", "heartrate", "stream push", "display"
+  };
+  uint16_t stage;
 
-  for (idx = 0; idx < size; idx++)
+  for (stage = 0; stage < kProfileNumStages; ++stage)
   {
-    printf("%u\n", array[idx]);
+    printf("%s: " PRINTF_ULONG " cycles " PRINTF_ULONG " max " PRINTF_ULONG " calls\n",
+           (char*)stage_names[stage],
+           (unsigned long)profile.stage[stage].cycles,
+           (unsigned long)profile.stage[stage].max_cycles,
+           (unsigned long)profile.stage[stage].calls);
   }
 #endif
 }
 
+#if STREAM_QRS_DETECTION == 0 && TEST_SAMPLE == 0
 /**
   @brief Copies value into each of the first size characters of the object pointer.
   */
@@ -128,6 +119,7 @@ static void memset(void* pointer, int8_t value, uint16_t size)
     size--;
   }
 }
+#endif
 
 /**
   @brief Parses a number into three digits to display on the LCD.
@@ -156,10 +148,8 @@ static void set_display_number(uint16_t value)
 
   uint8_t digit[3];
 
-  digit[0] = value % 10;
-  value /= 10;
-  digit[1] = value % 10;
-  digit[2] = value / 10;
+  value = fastdiv_divmod10(value, &digit[0]);
+  digit[2] = fastdiv_divmod10(value, &digit[1]);
 
   // Third digit can only display one(1).
   if (1 < digit[2])
@@ -167,68 +157,58 @@ static void set_display_number(uint16_t value)
     digit[2] = 2;  // Digit error.
   }
 
-  // Drive common to ground.
-  P4OUT = 0x00;
-
-  // Drive desired segments to high.
-  P2OUT = digit_to_off_or_one[digit[2]];
-  P6OUT = digit_to_seven_seg[digit[1]];
-  P3OUT = digit_to_seven_seg[digit[0]];
+  hal_set_display_segments(digit_to_seven_seg[digit[0]],
+                           digit_to_seven_seg[digit[1]],
+                           digit_to_off_or_one[digit[2]]);
 }
 
-
+#if ENABLE_RECORDING == 1 && TEST_SAMPLE == 0
 /**
-  @brief Initialize all pins as output and output low.
-  @notes This is done to ensure that there are no floating inputs.
-         This should be called before setting any other pins.
+  @brief Adds a sample to the recording.
+  @note Called from the ADC interrupt. A full block is handed to the main
+        loop and encoding continues in the other block. The full block is
+        dropped instead if the main loop is still sending the other block.
   */
-static void set_pins_to_output_low(void)
+static void record_sample(uint16_t sample)
 {
-  P1DIR = 0xFF;
-  P2DIR = 0xFF;
-  P3DIR = 0xFF;
-  P4DIR = 0xFF;
-  P5DIR = 0xFF;
-  P6DIR = 0xFF;
-  P7DIR = 0xFF;
-  P8DIR = 0xFF;
-  PJDIR = 0xFF;
-
-  P1OUT = 0x00;
-  P2OUT = 0x00;
-  P3OUT = 0x00;
-  P4OUT = 0x00;
-  P5OUT = 0x00;
-  P6OUT = 0x00;
-  P7OUT = 0x00;
-  P8OUT = 0x00;
-  PJOUT = 0x00;
+  uint16_t size;
+
+  size = codec_encode(&record_encoder, sample);
+  if (0 == size)
+  {
+    return;
+  }
+
+  if (record_block_size)
+  {
+    num_dropped_record_blocks++;
+  }
+  else
+  {
+    record_block_size = size;
+    record_block_index ^= 1;
+
+    // Clear low power mode to wake up CPU.
+    hal_exit_low_power_mode_on_exit();
+  }
+
+  codec_encoder_init(&record_encoder, (uint8_t*)record_blocks[record_block_index]);
 }
+#endif
 
 /**
-  @brief Copy source uint16_t array into destination for len.
-  @param  dst    The destination array to copy into.
-  @param  src    The source array to copy from.
-  @param  index  The starting index of the source to start copying from.
-  @param  len    The number of elements to copy.
-  @note This will unroll the source array so that the index will correspond with dst[0].
+  @brief Sends the recorded block that is waiting, if any.
   */
-static void unroll_array(uint16_t* dst, uint16_t* src, uint16_t index, uint16_t len)
+static void send_record_block(void)
 {
-  uint16_t count = len;
-
-  while (count)
+#if ENABLE_RECORDING == 1
+  if (record_block_size)
   {
-    *dst = src[index];
-    dst++;
-    index++;
-    count--;
-
-    if (index == len)
-    {
-      index = 0;
-    }
+    trace_write(kTraceStageRecording, record_blocks[record_block_index ^ 1],
+                (record_block_size + 1) >> 1);
+    record_block_size = 0;
   }
+#endif
 }
 
 /**
@@ -237,33 +217,33 @@ static void unroll_array(uint16_t* dst, uint16_t* src, uint16_t index, uint16_t
         the desired pins to high or driving common to high and the desired
         pins to low.
   */
+#ifdef __MSP430__
 #pragma vector=TIMER2_A0_VECTOR
+#endif
 __interrupt void refresh_display(void)
 {
-  P4OUT ^= 0x01;
-  P2OUT ^= 0xFF;
-  P6OUT ^= 0xFF;
-  P3OUT ^= 0xFF;
+  hal_toggle_display();
 }
 
 /**
   @brief Timer A1 interrupt service routine to start the ADC conversion.
   */
+#ifdef __MSP430__
 #pragma vector=TIMER1_A0_VECTOR
+#endif
 __interrupt void start_adc_conversion(void)
 {
 #if TEST_SAMPLE == 0
-  if (kStateSnapshotSample != state)
-  {
-    ADC12CTL0 |= ADC12SC; // Start conversion.
-  }
+  hal_start_adc_conversion();
 #endif
 }
 
 /**
   @brief Timer A0 interrupt service routine to start the processor.
   */
+#ifdef __MSP430__
 #pragma vector=TIMER0_A0_VECTOR
+#endif
 __interrupt void start_qrs_detector(void)
 {
   if (kStateIdle == state)
@@ -272,33 +252,57 @@ __interrupt void start_qrs_detector(void)
   }
 
   // Clear low power mode to wake up CPU.
-  __bic_SR_register_on_exit(LOW_POWER_MODE);
+  hal_exit_low_power_mode_on_exit();
 }
 
 /**
   @brief ADC interrupt routine to store sampled ADC value into an array.
   */
+#ifdef __MSP430__
 #pragma vector=ADC12_VECTOR
+#endif
 __interrupt void store_adc_value(void)
 {
 #if TEST_SAMPLE == 0
-  if (kStateSnapshotSample != state)
+  uint16_t sample;
+#if STREAM_QRS_DETECTION == 1
+  uint16_t is_beat;
+#endif
+
+  sample = hal_read_adc();
+
+#if STREAM_QRS_DETECTION == 1
+  PROFILE_STAGE(kProfileStageStreamPush,
+                is_beat = qrs_stream_push(&qrs_stream, sample));
+  if (is_beat)
   {
-    sample_array_pointer[sample_index] = ADC12MEM0;
-    ++sample_index;
+    state = kStateSetDisplay;
 
-    if (SAMPLE_LEN <= sample_index)
-    {
-      sample_index = 0;
-    }
+    // Clear low power mode to wake up CPU.
+    hal_exit_low_power_mode_on_exit();
   }
+#else
+  ring_push(&sample_ring, sample);
+#endif
+
+#if ENABLE_RECORDING == 1
+  record_sample(sample);
+#endif
 #endif
 }
 
 int main(void)
 {
+#if STREAM_QRS_DETECTION == 0
+#if ENABLE_LOGGING == 1
   uint16_t array_a[SAMPLE_LEN];
   uint16_t array_b[SAMPLE_LEN];
+#endif
+  qrs_ring_view_t sample_view;
+  uint16_t sample_count;
+#elif TEST_SAMPLE == 1
+  uint16_t idx;
+#endif
   uint16_t heartrate;
 
 #if TEST_SAMPLE == 1
@@ -383,39 +387,69 @@ int main(void)
      944,  886,  888,  932,  863,  883,  856,  859,  912,  903,  889,  936,  930,  919,  769,  857,
      876, 908
   };
-#else
-  uint16_t sample_array[SAMPLE_LEN];
+#elif STREAM_QRS_DETECTION == 0 && PACKED_SAMPLE_RING == 1
+  uint8_t sample_array[RING_PACKED_SIZE(SAMPLE_LEN + SAMPLE_RING_SLACK)];
+#elif STREAM_QRS_DETECTION == 0
+  uint16_t sample_array[SAMPLE_LEN + SAMPLE_RING_SLACK];
 #endif
 
-  // Stop watchdog timer.
-  WDTCTL = WDTPW | WDTHOLD;
+  hal_init_board();
+#if ENABLE_PROFILING == 1
+  hal_init_cycle_counter();
+#endif
 
   state = kStateIdle;
-  sample_index = 0;
-  sample_array_pointer = &sample_array[0];
   heartrate = 0;
+  qrs_stream_init(&qrs_stream, NULL);
+#if ENABLE_RECORDING == 1
+  record_block_index = 0;
+  record_block_size = 0;
+  num_dropped_record_blocks = 0;
+  codec_encoder_init(&record_encoder, (uint8_t*)record_blocks[record_block_index]);
+#endif
 
-#if TEST_SAMPLE == 0
+#if TEST_SAMPLE == 1
+  ring_init(&sample_ring, sample_array, SAMPLE_LEN, 0);
+#elif STREAM_QRS_DETECTION == 0 && PACKED_SAMPLE_RING == 1
+  memset(sample_array, 0, sizeof(sample_array));
+  ring_init_packed(&sample_ring, sample_array, SAMPLE_LEN + SAMPLE_RING_SLACK, 0);
+#elif STREAM_QRS_DETECTION == 0
   memset(sample_array, 0, sizeof(sample_array));
+  ring_init(&sample_ring, sample_array, SAMPLE_LEN + SAMPLE_RING_SLACK, 0);
 #endif
 
-  // Setting pins to low must be before any setup of other pins.
-  set_pins_to_output_low();
-  disable_usb();
+#if STREAM_QRS_DETECTION == 0 && TEST_SAMPLE == 0 && PACKED_SAMPLE_RING == 1
+  sample_view.base = NULL;
+  sample_view.packed = sample_array;
+  sample_view.capacity = sample_ring.capacity;
+#elif STREAM_QRS_DETECTION == 0
+  sample_view.base = sample_array;
+  sample_view.packed = NULL;
+  sample_view.capacity = sample_ring.capacity;
+#endif
 
-  init_adc();
-  init_detector_timer();
-  init_display_driver();
-  init_display_timer();
-  init_sampler_timer();
+  hal_init_adc();
+#if TEST_SAMPLE == 1 || STREAM_QRS_DETECTION == 0
+  hal_init_detector_timer(QRS_DETECTING_PERIOD);
+#endif
+  hal_init_display_driver();
+#if (ENABLE_LOGGING == 1 && ENABLE_TRACE == 1) || ENABLE_RECORDING == 1
+  hal_init_trace();
+#endif
+  hal_init_display_timer(DISPLAY_REFRESH_FREQUENCY);
+#if TEST_SAMPLE == 0
+  // ECG has a bandwidth up to 150 Hz.
+  // Spectrum analysis shows that the majority of the component in below 30 Hz.
+  hal_init_sampler_timer(SAMPLING_FREQUENCY);
+#endif
 
   set_display_number(0);
 
   // Enable interrupts.
-  __bis_SR_register(GIE);
+  hal_enable_interrupts();
 
   // Enter low power mode.
-  __bis_SR_register(LOW_POWER_MODE);
+  hal_enter_low_power_mode();
 
   for(;;)
   {
@@ -425,39 +459,85 @@ int main(void)
       {
         break;
       }
+#if STREAM_QRS_DETECTION == 1
+#if TEST_SAMPLE == 1
+      case kStateSnapshotSample:
+      {
+        // Replay the preset sample array through the streaming detector.
+        qrs_stream_init(&qrs_stream, NULL);
+        for (idx = 0; idx < SAMPLE_LEN; ++idx)
+        {
+          PROFILE_STAGE(kProfileStageStreamPush,
+                        qrs_stream_push(&qrs_stream, sample_array[idx]));
+        }
+
+        state = kStateSetDisplay;
+        break;
+      }
+#endif
+#else
       case kStateSnapshotSample:
       {
-        // Unroll array so that the first index is the start of the sample.
-        unroll_array(array_a, sample_array, sample_index, SAMPLE_LEN);
-        log_qrs_step("Original", array_a, SAMPLE_LEN);
+#if ENABLE_LOGGING == 1
+        // Copy the latest samples out of the sample ring so they can be
+        // logged while the ADC interrupt keeps writing. Copy again if the
+        // ADC interrupt overran the slack while reading.
+        do
+        {
+          sample_count = ring_get_window(&sample_ring, SAMPLE_LEN, &sample_view.start);
+          qrs_ring_view_copy(&sample_view, array_b, SAMPLE_LEN);
+        } while (!ring_is_window_intact(&sample_ring, SAMPLE_LEN, sample_count));
+
+        PROFILE_STAGE(kProfileStageHighPass,
+                      qrs_filter_high_pass(array_b, array_a, SAMPLE_LEN));
+
+        log_qrs_step(kTraceStageOriginal, "Original", array_b, SAMPLE_LEN);
+        log_qrs_step(kTraceStageHighPass, "High Pass", array_a, SAMPLE_LEN);
 
         state = kStateQrsDetect;
+#else
+        // Run all the steps of the QRS detection in one pass straight out of
+        // the sample ring. Run again if the ADC interrupt overran the slack.
+        do
+        {
+          sample_count = ring_get_window(&sample_ring, SAMPLE_LEN, &sample_view.start);
+          PROFILE_STAGE(kProfileStageHeartrate,
+                        heartrate = qrs_get_heartrate_ring(&sample_view, NULL, NULL, SAMPLE_LEN));
+        } while (!ring_is_window_intact(&sample_ring, SAMPLE_LEN, sample_count));
+
+        state = kStateSetDisplay;
+#endif
         break;
       }
+#if ENABLE_LOGGING == 1
       case kStateQrsDetect:
       {
-        qrs_filter_high_pass(array_a, array_b, SAMPLE_LEN);
-        log_qrs_step("High Pass", array_b, SAMPLE_LEN);
-
-        qrs_filter_low_pass(array_b, array_a, SAMPLE_LEN);
-        log_qrs_step("Low Pass", array_a, SAMPLE_LEN);
+        PROFILE_STAGE(kProfileStageLowPass,
+                      qrs_filter_low_pass(array_a, array_a, SAMPLE_LEN));
+        log_qrs_step(kTraceStageLowPass, "Low Pass", array_a, SAMPLE_LEN);
 
-        heartrate = qrs_get_heartrate(array_a, array_b, SAMPLE_LEN);
-        log_qrs_step("QRS Detection", array_b, SAMPLE_LEN);
+        PROFILE_STAGE(kProfileStageHeartrate,
+                      heartrate = qrs_get_heartrate(array_a, array_b, NULL, SAMPLE_LEN));
+        log_qrs_step(kTraceStageQrs, "QRS Detection", array_b, SAMPLE_LEN);
 
         state = kStateSetDisplay;
         break;
       }
+#endif
+#endif
       case kStateSetDisplay:
       {
+#if STREAM_QRS_DETECTION == 1
+        heartrate = qrs_stream_get_heartrate(&qrs_stream);
+        log_qrs_hrv(&qrs_stream.hrv);
+#endif
+
         if (MAX_HEARTRATE < heartrate)
         {
-          set_display_number(MAX_HEARTRATE);
-        }
-        else
-        {
-          set_display_number(heartrate);
+          heartrate = MAX_HEARTRATE;
         }
+        PROFILE_STAGE(kProfileStageDisplay, set_display_number(heartrate));
+        log_profile();
 
         state = kStateIdle;
         break;
@@ -469,8 +549,10 @@ int main(void)
       }
     }
 
+    send_record_block();
+
     // Enter low power mode.
-    __bis_SR_register(LOW_POWER_MODE);
+    hal_enter_low_power_mode();
   }
 }
 
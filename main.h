@@ -1,6 +1,12 @@
 #ifndef MAIN_H_
 #define MAIN_H_
 
+#include "codec.h"
+#include "hal.h"
+#include "profile.h"
+#include "qrs.h"
+#include "ring.h"
+
 // How often the heartbeat is updated (in seconds).
 #define QRS_DETECTING_PERIOD 2
 
@@ -8,11 +14,26 @@
 #define DISPLAY_REFRESH_FREQUENCY 1
 
 // How often the input is sampled (in Hz).
-#define SAMPLING_FREQUENCY 256
+// Set by QRS_SAMPLING_FREQUENCY (see qrs.h) so the QRS windows match.
+#define SAMPLING_FREQUENCY QRS_SAMPLING_FREQUENCY
 
 // Print debugging information to console.
 #define ENABLE_LOGGING 0
 
+// Send the logged arrays as binary frames (see trace.h) instead of printing
+// them. Decode with host/trace_decode.c.
+#define ENABLE_TRACE 0
+
+// Send the raw ADC samples losslessly compressed (see codec.h) as binary
+// frames. Decode with host/trace_decode.c.
+#define ENABLE_RECORDING 0
+
+// Count the cycles spent in each stage of the detector (see profile.h).
+#define ENABLE_PROFILING 0
+
+// Detect heartbeats as each sample arrives instead of every QRS_DETECTING_PERIOD.
+#define STREAM_QRS_DETECTION 1
+
 // Test QRS detection with a preset sample array.
 #define TEST_SAMPLE 0
 
@@ -23,25 +44,40 @@
 #define MAX_HEARTRATE 199
 
 // Length of sample array.
+// 1250 samples is about 4.9 s at 256 Hz. This is not scaled with
+// SAMPLING_FREQUENCY because of the limited RAM. The window must cover at
+// least two beats for the batch detector to give a heartrate.
 #define SAMPLE_LEN 1250
 
+// Store the sample ring as 12-bit samples, two in three bytes.
+// Saves a quarter of the ring's RAM. Not used with TEST_SAMPLE.
+#define PACKED_SAMPLE_RING 1
+
+// Extra samples in the sample ring so the ADC interrupt can keep writing
+// while the latest SAMPLE_LEN samples are copied out.
+#define SAMPLE_RING_SLACK 32
+
 // The states of the  finite state machine.
 typedef enum {
   kStateIdle,
-  kStateSnapshotSample, // Copy the current sample array.
-  kStateQrsDetect,      // Process sample array to get heart rate and update the display.
+  kStateSnapshotSample, // Process the latest samples in the sample ring.
+  kStateQrsDetect,      // Finish processing the logged steps to get heart rate.
   kStateSetDisplay      // Update the display.
 } state_t;
 
-// The current state.
-state_t state = kStateIdle;
-
-// The current index in the sample array.
-int16_t sample_index = 0;
-
-// Pointer to sample array in main. The sample array is not global
-// because if it is then the CPU will hang on init_zero.
-uint16_t* sample_array_pointer = NULL;
+#if ENABLE_PROFILING == 1
+// Run the statement and add its cycles to the counters of the stage in
+// profile (see main.c).
+#define PROFILE_STAGE(stage, statement)                                        \
+  do                                                                           \
+  {                                                                            \
+    uint32_t profile_start = hal_read_cycle_counter();                         \
+    statement;                                                                 \
+    profile_record(&profile, stage, hal_read_cycle_counter() - profile_start); \
+  } while (0)
+#else
+#define PROFILE_STAGE(stage, statement) statement
+#endif
 
 /**
   @brief Sample, detect and show heartrate.
@@ -1,52 +1,41 @@
 #include <msp430.h>
 #include "consoleio.h"
+#include "fastdiv.h"
 #include "printf.h"
 #include "stdarg.h"
 
-static const unsigned long dv[] = {
-//  4294967296      // 32 bit unsigned max
-    1000000000,     // +0
-     100000000,     // +1
-      10000000,     // +2
-       1000000,     // +3
-        100000,     // +4
-//       65535      // 16 bit unsigned max
-         10000,     // +5
-          1000,     // +6
-           100,     // +7
-            10,     // +8
-             1,     // +9
-};
-
-static void xtoa(unsigned long x, const unsigned long *dp)
+/**
+  @brief Print an unsigned number in decimal.
+  @note The digits are split off with multiply-shift divisions by ten (see
+        fastdiv.h) from the least significant end, so they are buffered.
+  */
+static void xtoa(unsigned long x)
 {
-  char c;
-  unsigned long d;
+  char buf[10]; // 4294967295 has ten digits.
+  uint8_t digit;
+  uint16_t n;
+  unsigned x16;
 
-  if (x)
-  {
-    while (x < *dp)
-    {
-      ++dp;
-    }
+  n = 0;
 
-    do
-    {
-      d = *dp++;
-      c = '0';
+  // The 32-bit multiply is only needed while x does not fit in 16 bits.
+  while (x > 0xFFFF)
+  {
+    x = fastdiv_divmod10_long(x, &digit);
+    buf[n++] = '0' + digit;
+  }
 
-      while (x >= d)
-      {
-        ++c;
-        x -= d;
-      }
-      putc(c);
-    }
-    while (!(d & 1));
+  x16 = (unsigned)x;
+  do
+  {
+    x16 = fastdiv_divmod10(x16, &digit);
+    buf[n++] = '0' + digit;
   }
-  else
+  while (x16);
+
+  while (n)
   {
-    putc('0');
+    putc(buf[--n]);
   }
 }
 
@@ -95,7 +84,7 @@ void printf(char *format, ...)
             i = -i;
             putc('-');
           }
-          xtoa((unsigned)i, dv + 5);
+          xtoa((unsigned)i);
           break;
         }
 
@@ -108,7 +97,7 @@ void printf(char *format, ...)
             n = -n;
             putc('-');
           }
-          xtoa((unsigned long)n, dv);
+          xtoa((unsigned long)n);
           break;
         }
 
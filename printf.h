@@ -1,10 +1,26 @@
 #ifndef PRINTF_H_
 #define PRINTF_H_
 
+#ifdef __MSP430__
+
 /**
   @brief Small printf function with code size about 640 bytes.
   */
 void printf(char *format, ...);
 
+/**
+  @brief The conversion for an unsigned long argument.
+  */
+#define PRINTF_ULONG "%n"
+
+#else
+
+// Use the C library printf on a host.
+#include <stdio.h>
+
+#define PRINTF_ULONG "%lu"
+
+#endif // __MSP430__
+
 #endif // PRINTF_H_
 
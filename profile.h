@@ -0,0 +1,59 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+
+// Per-stage cycle counts of the detector.
+// The stages are timed with hal_read_cycle_counter (see hal.h) by the
+// PROFILE_STAGE macro in main.h, which compiles to the bare statement unless
+// ENABLE_PROFILING is set.
+
+/**
+  @brief The timed stages.
+  */
+typedef enum {
+  kProfileStageHighPass,   // Batch high pass filter (with the ring snapshot).
+  kProfileStageLowPass,    // Batch low pass filter.
+  kProfileStageHeartrate,  // Batch threshold detection, or all steps fused.
+  kProfileStageStreamPush, // Streaming detector, per sample.
+  kProfileStageDisplay,    // Formatting and driving the display.
+  kProfileNumStages
+} profile_stage_t;
+
+/**
+  @brief The counters of one stage.
+  */
+typedef struct {
+  uint32_t cycles;     // Total cycles spent in the stage.
+  uint32_t max_cycles; // Longest single call.
+  uint32_t calls;      // Number of calls.
+} profile_counter_t;
+
+/**
+  @brief The counters of all stages.
+  @note Cycles are counter ticks: CPU cycles on the MSP430 and nanoseconds
+        on the host.
+  */
+typedef struct {
+  profile_counter_t stage[kProfileNumStages];
+} profile_t;
+
+/**
+  @brief Add one call of a stage to the counters.
+  @param profile   The counters.
+  @param stage     The stage.
+  @param cycles    The cycles the call took.
+  */
+static inline void profile_record(profile_t* profile, profile_stage_t stage, uint32_t cycles)
+{
+  profile_counter_t* counter = &profile->stage[stage];
+
+  counter->cycles += cycles;
+  counter->calls++;
+  if (cycles > counter->max_cycles)
+  {
+    counter->max_cycles = cycles;
+  }
+}
+
+#endif // PROFILE_H_
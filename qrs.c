@@ -1,46 +1,71 @@
+#include <stddef.h>
 #include "qrs.h"
+#include "fastdiv.h"
+#include "qrs_pipeline.h"
 
 #define square(x) ((x)*(x))
 
 // Below are the customizable paramaters for the QRS detection algorithm.
 // These change depending on the sampling frequency.
-// These parameters are tuned for a 256 Hz sampling frequency.
+// These parameters are tuned for a 256 Hz sampling frequency and scaled to
+// QRS_SAMPLING_FREQUENCY at compile time (see qrs.h). The threshold detection
+// parameters are the defaults of qrs_params_t.
 // Also windows were selected as powers of two for processing efficiency.
 
 /**
   @brief Width of the moving summation for the low pass filter.
   @note Suggested low-pass width should correspond to 150 ms in real-time.
-        32 / 250 = 128ms.
+        32 / 256 Hz = 125 ms.
   */
-const int kLowPassWindowSize = 32;
+static const int kLowPassWindowSize = QRS_LOW_PASS_WINDOW_SIZE;
 
 /**
   @brief Moving average window for the high pass filter.
+  @note 16 / 256 Hz = 62.5 ms.
   */
-const uint16_t kHighPassWindowSize = 16;
-const uint16_t kHighPassWindowSizePowerOfTwo = 4;
+static const uint16_t kHighPassWindowSizePowerOfTwo = QRS_HIGH_PASS_WINDOW_SHIFT;
+
+/**
+  @brief Right shift applied to the low pass sum (see qrs.h).
+  */
+static const uint16_t kLowPassOutputShift = QRS_LOW_PASS_OUTPUT_SHIFT;
 
 /**
   @brief Width of the frame to decide if it contains a QRS.
   @note Size of the decision frame to determine if frame contains a QRS. The
         width of this frame should be a slightly wider than the width of the
         average QRS based on the ECG sampling rate.
-        Average resting heart rate = 250 Hz * 60 / 75HBpm = 200 samp
+        Average resting heart rate = 256 Hz * 60 / 77 HBpm = 200 samp
+  */
+static const uint16_t kQrsDecideFrameSize = QRS_SAMPLES_FROM_256_HZ(200);
+
+/**
+  @brief Width of the window the peak of each decision frame is taken over.
+  @note The peak is tracked with a sliding maximum while the frame is walked,
+        so this may differ from kQrsDecideFrameSize at no extra cost. It must
+        not exceed QRS_PEAK_WINDOW_MAX_SIZE.
   */
-const uint16_t kQrsDecideFrameSize = 200;
+static const uint16_t kQrsPeakWindowSize = QRS_SAMPLES_FROM_256_HZ(200);
 
 /**
   @brief Width of the frame to get the initial threshold.
   @note Size of the frame to get the the initial peak.
-        Min resting heart rate = 250Hz * 60 / 350 = 43 HBpm
+        Min resting heart rate = 256 Hz * 60 / 350 = 44 HBpm
   */
-const uint16_t kQrsInitialFrameSize = 350;
+static const uint16_t kQrsInitialFrameSize = QRS_SAMPLES_FROM_256_HZ(350);
 
 /**
   @brief The minimum number of samples in between heartbeats.
-  @note Max heart rate = (250Hz * 60) / 75 = 200 HBpm.
+  @note Max heart rate = (256 Hz * 60) / 75 = 205 HBpm.
   */
-const uint16_t kMinSamplesBetweenBeats = 75;
+static const uint16_t kMinSamplesBetweenBeats = QRS_SAMPLES_FROM_256_HZ(75);
+
+/**
+  @brief Weights of the threshold update (see CalculateNewThreshold).
+  @note Scaled by 2^10. alpha = 0.05 and gamma = 0.15.
+  */
+static const uint16_t kThresholdAlphaTimesGamma = 8; // 0.0075 * 1024 = 8
+static const uint16_t kThresholdOneMinusAlpha = 973; // 0.95 * 1024 = 973
 
 /**
   @brief Used to get the heart beats per minute.
@@ -48,67 +73,263 @@ const uint16_t kMinSamplesBetweenBeats = 75;
         sampFreq=256Hz so 60*256 = 15360
         Set here to avoid recalculation.
   */
-const uint16_t kSecondsTimesSampFreq = 15360;
+static const uint16_t kSecondsTimesSampFreq = 60L * QRS_SAMPLING_FREQUENCY;
+
+// The shortest heartbeat interval the detectors can report.
+#define FIRST_RR (QRS_SAMPLES_FROM_256_HZ(75) + 1)
+
+// The number of heartbeat intervals in the heart rate table (512 at 256 Hz,
+// which reaches down to 26 HBpm).
+#define RR_TABLE_SIZE (32 << QRS_HIGH_PASS_WINDOW_SHIFT)
+
+// Generators for the heart rate table. The divisions are constant.
+#define BPM(rr) (uint8_t)(60L * QRS_SAMPLING_FREQUENCY / (rr))
+#define BPM2(rr) BPM(rr), BPM((rr) + 1)
+#define BPM4(rr) BPM2(rr), BPM2((rr) + 2)
+#define BPM8(rr) BPM4(rr), BPM4((rr) + 4)
+#define BPM16(rr) BPM8(rr), BPM8((rr) + 8)
+#define BPM32(rr) BPM16(rr), BPM16((rr) + 16)
+#define BPM64(rr) BPM32(rr), BPM32((rr) + 32)
+#define BPM128(rr) BPM64(rr), BPM64((rr) + 64)
+#define BPM256(rr) BPM128(rr), BPM128((rr) + 128)
+#define BPM512(rr) BPM256(rr), BPM256((rr) + 256)
+#define BPM1024(rr) BPM512(rr), BPM512((rr) + 512)
+#define BPM2048(rr) BPM1024(rr), BPM1024((rr) + 1024)
+
+/**
+  @brief Heart rate of each heartbeat interval from FIRST_RR.
+  @note kSecondsTimesSampFreq / rr rounded down, generated at compile time.
+        All entries fit in a byte since the fastest rate is about 205 HBpm.
+  */
+static const uint8_t kBeatsPerMinute[RR_TABLE_SIZE] = {
+#if RR_TABLE_SIZE == 128
+  BPM128(FIRST_RR)
+#elif RR_TABLE_SIZE == 256
+  BPM256(FIRST_RR)
+#elif RR_TABLE_SIZE == 512
+  BPM512(FIRST_RR)
+#elif RR_TABLE_SIZE == 1024
+  BPM1024(FIRST_RR)
+#else
+  BPM2048(FIRST_RR)
+#endif
+};
+
+/**
+  @brief Reciprocals of the number of intervals averaged by a detector.
+  @note The sum of up to 15 heart rates below 256 HBpm is below 4096, so
+        fastdiv_divide is exact for these divisors.
+  */
+static const uint32_t kHeartbeatReciprocals[QRS_MAX_AVERAGED_BEATS] = {
+  0,
+  FASTDIV_RECIPROCAL(1),  FASTDIV_RECIPROCAL(2),  FASTDIV_RECIPROCAL(3),
+  FASTDIV_RECIPROCAL(4),  FASTDIV_RECIPROCAL(5),  FASTDIV_RECIPROCAL(6),
+  FASTDIV_RECIPROCAL(7),  FASTDIV_RECIPROCAL(8),  FASTDIV_RECIPROCAL(9),
+  FASTDIV_RECIPROCAL(10), FASTDIV_RECIPROCAL(11), FASTDIV_RECIPROCAL(12),
+  FASTDIV_RECIPROCAL(13), FASTDIV_RECIPROCAL(14), FASTDIV_RECIPROCAL(15)
+};
+
+#if QRS_MAX_AVERAGED_BEATS != 16
+#error "kHeartbeatReciprocals must have QRS_MAX_AVERAGED_BEATS entries."
+#endif
+
+/**
+  @brief Return the heart rate of a heartbeat interval without dividing.
+  @param  rr  The number of samples between two heartbeats.
+  @return kSecondsTimesSampFreq / rr.
+  */
+static inline uint16_t GetBeatsPerMinute(uint16_t rr)
+{
+  uint16_t bpm;
+  uint16_t remaining;
+
+  if ((uint16_t)(rr - FIRST_RR) < RR_TABLE_SIZE)
+  {
+    return kBeatsPerMinute[rr - FIRST_RR];
+  }
+
+  // Longer intervals are slower than the last entry of the table, so the
+  // quotient takes only a few subtractions.
+  bpm = 0;
+  remaining = kSecondsTimesSampFreq;
+  while (remaining >= rr)
+  {
+    remaining -= rr;
+    bpm++;
+  }
+
+  return bpm;
+}
 
 /**
-  @brief Calculate y1[n] for the moving average high pass filter.
-  @param  data  The raw ECG signal.
-  @param  n  The index of the signal to calculate y1 for.
-  @return The calculation of y1 for the given n.
-  @note The equation is given below: (M is the window size for the high pass)
-                       M-1
-        y1[n] = 1/M  *  Σ (data[n-m])
-                       m=0
+  @brief Return the integer square root.
+  @param  value  The radicand.
+  @return The square root of value rounded down.
+  @note Bit by bit so it needs no division.
   */
-static inline uint16_t CalculateHighPassY1(uint16_t n, uint16_t* data, uint16_t size)
+static uint32_t SquareRoot(uint64_t value)
 {
-  int16_t index;
-  uint16_t sum;
-  uint16_t m;
+  uint64_t root;
+  uint64_t bit;
 
-  sum = 0;
+  root = 0;
+  bit = (uint64_t)1 << 62;
 
-  for (m = 0; m < kHighPassWindowSize; ++m)
+  while (bit > value)
   {
-    index = n - m;
+    bit >>= 2;
+  }
 
-    // Reuse first term if index will be negative.
-    if (0 > index)
+  while (bit)
+  {
+    if (value >= root + bit)
     {
-      index = 0;
+      value -= root + bit;
+      root = (root >> 1) + bit;
     }
-
-    sum += data[index];
+    else
+    {
+      root >>= 1;
+    }
+    bit >>= 2;
   }
 
-  return sum >> kHighPassWindowSizePowerOfTwo;
+  return root;
 }
 
 /**
-  @brief Calculate y2[n] for the moving average high pass filter.
-  @param  data  The raw ECG signal.
-  @param  n  The index of the signal to calculate y2 for.
-  @return The calculation of y2 for the given n.
-  @note The equation is given below: (M is the window size for the high pass)
-        y2[n] = data[n - (M+1)/2]
+  @brief Convert a deviation in 1/16 samples to milliseconds.
+  @param  deviation  The deviation in 1/16 samples.
+  @return The deviation in milliseconds, rounded and saturated at 0xFFFF.
   */
-static inline uint16_t CalculateHighPassY2(uint16_t n, uint16_t* data, uint16_t size)
+static uint16_t DeviationToMilliseconds(uint32_t deviation)
 {
-  int16_t index;
+  uint32_t milliseconds;
+
+  // 1000 / (16 * fs) = 125 / (2 * fs).
+  milliseconds = (deviation * 125 + QRS_SAMPLING_FREQUENCY) / (2 * QRS_SAMPLING_FREQUENCY);
+
+  return (milliseconds > 0xFFFF) ? 0xFFFF : milliseconds;
+}
 
-  index = n - (kHighPassWindowSize + 1) / 2;
+/**
+  @brief Return the absolute difference of two intervals.
+  */
+static uint16_t GetIntervalDifference(uint16_t a, uint16_t b)
+{
+  return (a > b) ? a - b : b - a;
+}
 
-  // Reuse first term if index will be negative.
-  if (index < 0)
+/**
+  @brief Return 1 if a successive difference is over 50 ms, otherwise 0.
+  @note diff / fs > 50 / 1000 without dividing.
+  */
+static uint16_t IsNn50(uint16_t diff)
+{
+  return (uint32_t)diff * 20 > QRS_SAMPLING_FREQUENCY;
+}
+
+/**
+  @brief Return the index after the given index of a circular buffer.
+  @param  view  The view of the circular buffer.
+  @param  index  The index in the circular buffer.
+  @return The next index, wrapping to 0 at the end of the buffer.
+  */
+static inline uint16_t NextRingIndex(const qrs_ring_view_t* view, uint16_t index)
+{
+  ++index;
+
+  if (view->capacity <= index)
   {
     index = 0;
   }
 
-  return data[index];
+  return index;
+}
+
+/**
+  @brief Scale a low pass sum to a low pass output.
+  @param  z_sum  The sum of the squared high pass outputs.
+  @return The low pass output saturated at 0xFFFF.
+  */
+static inline uint16_t ScaleLowPass(uint32_t z_sum)
+{
+  z_sum >>= kLowPassOutputShift;
+
+  if (z_sum > 0xFFFF)
+  {
+    return 0xFFFF;
+  }
+
+  return z_sum;
 }
 
+/**
+  @brief Read a raw sample from a view.
+  @param  view  The view of the raw ECG signal.
+  @param  index  The index in the circular buffer.
+  @return The sample, unpacked if the view is packed.
+  @note Sample i of a packed view starts at byte i + i / 2. An even sample
+        takes a byte and the low nibble of the next byte, an odd sample the
+        high nibble and the byte after it.
+  */
+static inline uint16_t ReadSample(const qrs_ring_view_t* view, uint16_t index)
+{
+  const uint8_t* packed;
+
+  if (NULL == view->packed)
+  {
+    return view->base[index];
+  }
+
+  packed = view->packed + index + (index >> 1);
+
+  if (index & 1)
+  {
+    return (packed[0] >> 4) | ((uint16_t)packed[1] << 4);
+  }
+
+  return packed[0] | ((uint16_t)(packed[1] & 0x0F) << 8);
+}
+
+/**
+  @brief The source stage of the pipelines (see qrs_pipeline.h) that reads
+         a ring view.
+  @note Each raw sample is read from the view once.
+  */
+typedef qrs_ring_view_t RingSourceInput;
+
+typedef struct {
+  const qrs_ring_view_t* view; // The view of the raw ECG signal.
+  uint16_t next;               // The index in the view of the next sample.
+} RingSource;
+
+static inline uint16_t RingSourceStart(RingSource* source, const qrs_ring_view_t* view)
+{
+  source->view = view;
+  source->next = view->start;
+
+  return ReadSample(view, view->start);
+}
+
+static inline uint16_t RingSourceNext(RingSource* source)
+{
+  uint16_t sample;
+
+  sample = ReadSample(source->view, source->next);
+  source->next = NextRingIndex(source->view, source->next);
+
+  return sample;
+}
+
+// The filter stages of the detector.
+QRS_PIPELINE_HIGH_PASS(HighPass, QRS_HIGH_PASS_WINDOW_SHIFT, qrs_hp_sum_t)
+QRS_PIPELINE_MOVING_SUM(LowPass, QRS_HIGH_PASS_WINDOW_SHIFT + 1, QRS_LOW_PASS_OUTPUT_SHIFT,
+                        QRS_PIPELINE_SQUARE)
+
 /**
   @brief Calculate the new threshold based on old threshold and the max value from last sample.
+  @param  params  The tuning with alpha * gamma and 1 - alpha.
   @param  old_threshold  The old threshold value.
   @param  new_peak  The new max peak of the current frame.
   @return The new threshold
@@ -117,18 +338,15 @@ static inline uint16_t CalculateHighPassY2(uint16_t n, uint16_t* data, uint16_t
         gamma=0.15 or gamma=0.20
         NewThreshold = alpha * gamma * new_peak + (1-alpha) * old_threshold
   */
-static inline uint16_t CalculateNewThreshold(uint16_t old_threshold, uint16_t new_peak)
+static inline uint16_t CalculateNewThreshold(const qrs_params_t* params,
+                                             uint16_t old_threshold, uint16_t new_peak)
 {
   uint32_t new_threshold;
   uint32_t retval;
-  uint32_t one_minus_alpha;
-  uint32_t alpha_times_gamma;
 
   // Scaled by 2^10.
-  alpha_times_gamma = 8; // 0.05 * 0.15 = 0.0075 * 1024 = 8
-  one_minus_alpha = 973; // 1 - 0.05 = 0.95 * 1024 = 973
-
-  new_threshold = alpha_times_gamma * new_peak + one_minus_alpha * old_threshold;
+  new_threshold = (uint32_t)params->alpha_times_gamma * new_peak +
+                  (uint32_t)params->one_minus_alpha * old_threshold;
 
   retval = new_threshold >> 10;
   return retval;
@@ -163,136 +381,697 @@ static inline uint16_t GetPeak(uint16_t first_index, uint16_t last_index, uint16
   return peak;
 }
 
-void qrs_filter_high_pass(uint16_t* data, uint16_t* data_hp, uint16_t size)
+/**
+  @brief State of the threshold detection over the low pass output.
+  */
+typedef struct {
+  const qrs_params_t* params;       // The tuning.
+  qrs_peak_t peak;                  // Peak of the current decision frame.
+  uint16_t threshold;               // The current threshold.
+  uint16_t frame_count;             // Outputs seen in the current frame.
+  uint16_t cur_num_samp_btwn_beats; // Samples since the last heartbeat.
+  uint16_t heartbeat_count;         // Number of heartbeats averaged.
+  uint16_t heartrate_sum;           // Sum of the heart rates of the intervals.
+} Detector;
+
+/**
+  @brief Start threshold detection with the given initial threshold.
+  */
+static void StartDetector(Detector* detector, const qrs_params_t* params, uint16_t threshold)
 {
-  uint16_t y1_n;
-  uint16_t y2_n;
-  uint16_t n;
+  detector->params = params;
+  qrs_peak_init(&detector->peak, params->peak_window_size);
+  detector->threshold = threshold;
+  detector->frame_count = 0;
+  detector->cur_num_samp_btwn_beats = 0;
+  detector->heartbeat_count = 0;
+  detector->heartrate_sum = 0;
+}
 
-  for (n = 0; n < size; ++n)
-  {
-    y1_n = CalculateHighPassY1(n, data, size);
-    y2_n = CalculateHighPassY2(n, data, size);
+/**
+  @brief Run threshold detection on the next low pass output.
+  @param  detector  The threshold detection state.
+  @param  lp_n  The next low pass output.
+  @return 1 if a heartbeat is detected, otherwise 0.
+  @note The threshold is updated from the peak at the end of each frame.
+  */
+static inline uint16_t NextDetector(Detector* detector, uint16_t lp_n)
+{
+  uint16_t is_beat;
+
+  qrs_peak_push(&detector->peak, lp_n);
+
+  is_beat = 0;
 
-    if (y2_n > y1_n)
+  if (detector->cur_num_samp_btwn_beats > detector->params->min_samples_between_beats &&
+      lp_n >= detector->threshold)
+  {
+    // Do not use the first number of samples between heartbeats
+    // because it is actually the number of samples from the starting
+    // to the first heartbeat. Therefore unreliable to use.
+    // Later heartbeats are still reported once the average is full.
+    if (detector->heartbeat_count < QRS_MAX_AVERAGED_BEATS)
     {
-      data_hp[n] = y2_n - y1_n;
+      if (detector->heartbeat_count > 0)
+      {
+        detector->heartrate_sum += GetBeatsPerMinute(detector->cur_num_samp_btwn_beats);
+      }
+      detector->heartbeat_count++;
     }
-    else
+    detector->cur_num_samp_btwn_beats = 0;
+    is_beat = 1;
+  }
+  else
+  {
+    detector->cur_num_samp_btwn_beats++;
+  }
+
+  detector->frame_count++;
+  if (detector->frame_count >= detector->params->decide_frame_size)
+  {
+    detector->threshold = CalculateNewThreshold(detector->params, detector->threshold,
+                                                qrs_peak_get(&detector->peak));
+    detector->frame_count = 0;
+  }
+
+  return is_beat;
+}
+
+/**
+  @brief Start recording heartbeat positions for a window.
+  @param  beats  The heartbeat positions or NULL.
+  @param  size  The size of the window.
+  */
+static void StartBeats(qrs_beats_t* beats, uint16_t size)
+{
+  uint16_t i;
+
+  if (NULL == beats)
+  {
+    return;
+  }
+
+  beats->count = 0;
+
+  if (beats->bitset)
+  {
+    for (i = 0; i < QRS_BITSET_WORDS(size); ++i)
     {
-      data_hp[n] = 0;
+      beats->bitset[i] = 0;
     }
   }
 }
 
+/**
+  @brief Record the position of a heartbeat.
+  @param  beats  The heartbeat positions or NULL.
+  @param  i  The sample index of the heartbeat.
+  */
+static inline void RecordBeat(qrs_beats_t* beats, uint16_t i)
+{
+  if (NULL == beats)
+  {
+    return;
+  }
+
+  if (beats->count < QRS_BEATS_MAX_COUNT)
+  {
+    beats->index[beats->count++] = i;
+  }
+
+  if (beats->bitset)
+  {
+    beats->bitset[i >> 4] |= 1U << (i & 15);
+  }
+}
+
+/**
+  @brief Return the average heart rate of the detected heartbeats.
+  */
+static uint16_t GetDetectorHeartrate(const Detector* detector)
+{
+  // At least two heartbeats are needed for one interval. This happens when
+  // the window is short for the sampling frequency.
+  if (detector->heartbeat_count < 2)
+  {
+    return 0;
+  }
+
+  // Get the average heartrate.
+  return fastdiv_divide(detector->heartrate_sum,
+                        kHeartbeatReciprocals[detector->heartbeat_count - 1]);
+}
+
+/**
+  @brief The detector stage of the fused pipeline: threshold detection that
+         marks and records the heartbeats.
+  */
+typedef struct {
+  Detector detector;          // The threshold detection state.
+  const qrs_params_t* params; // The tuning.
+  uint16_t* data_qrs;         // The heartbeat markers or NULL.
+  qrs_beats_t* beats;         // The heartbeat positions or NULL.
+} ThresholdStage;
+
+static inline void ThresholdStageStart(ThresholdStage* stage, uint16_t threshold)
+{
+  StartDetector(&stage->detector, stage->params, threshold);
+}
+
+static inline void ThresholdStageNext(ThresholdStage* stage, uint16_t lp_n, uint16_t n)
+{
+  uint16_t is_beat;
+
+  is_beat = NextDetector(&stage->detector, lp_n);
+
+  if (stage->data_qrs)
+  {
+    stage->data_qrs[n] = is_beat;
+  }
+
+  if (is_beat)
+  {
+    RecordBeat(stage->beats, n);
+  }
+}
+
+// The high pass and low pass filters and the threshold detection fused into
+// one pass over the raw ECG signal.
+QRS_PIPELINE(FusedPipeline, RingSource, HighPass, LowPass, ThresholdStage)
+
+void qrs_ring_view_copy(const qrs_ring_view_t* view, uint16_t* data, uint16_t size)
+{
+  uint16_t index;
+  uint16_t n;
+
+  index = view->start;
+  for (n = 0; n < size; ++n)
+  {
+    data[n] = ReadSample(view, index);
+    index = NextRingIndex(view, index);
+  }
+}
+
+void qrs_filter_high_pass(uint16_t* data, uint16_t* data_hp, uint16_t size)
+{
+  qrs_ring_view_t view;
+
+  view.base = data;
+  view.packed = NULL;
+  view.capacity = size;
+  view.start = 0;
+
+  qrs_filter_high_pass_ring(&view, data_hp, size);
+}
+
+void qrs_filter_high_pass_ring(const qrs_ring_view_t* view, uint16_t* data_hp, uint16_t size)
+{
+  RingSource source;
+  HighPass hp;
+  uint16_t n;
+
+  if (0 == size)
+  {
+    return;
+  }
+
+  HighPassStart(&hp, RingSourceStart(&source, view));
+
+  for (n = 0; n < size; ++n)
+  {
+    data_hp[n] = HighPassNext(&hp, RingSourceNext(&source));
+  }
+}
+
 void qrs_filter_low_pass(uint16_t* data_hp, uint16_t* data_lp, uint16_t size)
 {
+  qrs_ring_view_t view;
+
+  view.base = data_hp;
+  view.packed = NULL;
+  view.capacity = size;
+  view.start = 0;
+
+  qrs_filter_low_pass_ring(&view, data_lp, size);
+}
+
+void qrs_filter_low_pass_ring(const qrs_ring_view_t* view, uint16_t* data_lp, uint16_t size)
+{
+  uint32_t squares[QRS_LOW_PASS_WINDOW_SIZE];
+  uint32_t last_square;
+  uint32_t last;
   uint32_t z_n;
+  uint16_t* data_hp;
+  uint16_t ahead;
   uint16_t n;
-  uint16_t i;
   uint16_t index;
 
-  for (n = 0; n < size; n++)
+  if (0 == size)
   {
-    z_n = 0;
+    return;
+  }
 
-    // Sum up the kLowPassWindowSize squared terms.
-    for (i = n; i < n + kLowPassWindowSize; ++i)
-    {
-      index = i;
+  data_hp = view->base;
 
-      // For the last several terms, reuse the last term for the moving average.
-      if (index >= size)
-      {
-        index = size - 1;
-      }
+  // For the last several terms, reuse the last term for the moving average.
+  last = (uint32_t)view->start + size - 1;
+  if (last >= view->capacity)
+  {
+    last -= view->capacity;
+  }
+  last_square = square(data_hp[last]);
 
-      z_n += square(data_hp[index]);
+  // Sum up the first kLowPassWindowSize squared terms.
+  ahead = view->start;
+  z_n = 0;
+  for (n = 0; n < kLowPassWindowSize; ++n)
+  {
+    if (n < size)
+    {
+      squares[n] = square(data_hp[ahead]);
+      ahead = NextRingIndex(view, ahead);
     }
+    else
+    {
+      squares[n] = last_square;
+    }
+
+    z_n += squares[n];
+  }
+
+  for (n = 0; n < size; n++)
+  {
+    data_lp[n] = ScaleLowPass(z_n);
 
-    if (z_n > 0xFFFF)
+    // Slide the window by replacing data_hp[n]^2 with data_hp[n+M]^2 so
+    // each term is squared only once.
+    index = n & (QRS_LOW_PASS_WINDOW_SIZE - 1);
+    z_n -= squares[index];
+
+    if (n + kLowPassWindowSize < size)
     {
-      data_lp[n] = 0xFFFF;
+      squares[index] = square(data_hp[ahead]);
+      ahead = NextRingIndex(view, ahead);
     }
     else
     {
-      data_lp[n] = z_n;
+      squares[index] = last_square;
     }
+
+    z_n += squares[index];
   }
 }
 
-uint16_t qrs_get_heartrate(uint16_t* data_lp, uint16_t* data_qrs, uint16_t size)
+void qrs_params_init(qrs_params_t* params)
+{
+  params->alpha_times_gamma = kThresholdAlphaTimesGamma;
+  params->one_minus_alpha = kThresholdOneMinusAlpha;
+  params->initial_frame_size = kQrsInitialFrameSize;
+  params->decide_frame_size = kQrsDecideFrameSize;
+  params->peak_window_size = kQrsPeakWindowSize;
+  params->min_samples_between_beats = kMinSamplesBetweenBeats;
+}
+
+uint16_t qrs_get_heartrate(uint16_t* data_lp, uint16_t* data_qrs, qrs_beats_t* beats, uint16_t size)
 {
-  uint16_t heartbeat_count;
-  uint16_t heartbeat_rate;
-  uint16_t threshold;
-  uint16_t new_peak;
-  uint16_t first_frame_index;
-  uint16_t last_frame_index;
-  uint16_t cur_num_samp_btwn_beats;
-  uint16_t num_samp_btwn_beats[16];
+  qrs_params_t params;
+  Detector detector;
+  uint16_t is_beat;
   uint16_t i;
 
-  heartbeat_count = 0;
-  heartbeat_rate = 0;
-  cur_num_samp_btwn_beats = 0;
+  qrs_params_init(&params);
 
   // The initial threshold is the largest value of the first frame.
-  first_frame_index = 0;
-  last_frame_index  = kQrsInitialFrameSize;
-  threshold = GetPeak(first_frame_index, last_frame_index, data_lp, size);
+  StartDetector(&detector, &params, GetPeak(0, params.initial_frame_size, data_lp, size));
+  StartBeats(beats, size);
 
   // Detect heartbeats.
-  for (first_frame_index = 0;
-       first_frame_index < size;
-       first_frame_index += kQrsDecideFrameSize)
+  for (i = 0; i < size; ++i)
   {
-    // Ensure the frame does not go out of array bounds.
-    last_frame_index = first_frame_index + kQrsDecideFrameSize;
-    if (last_frame_index > size)
+    is_beat = NextDetector(&detector, data_lp[i]);
+
+    if (data_qrs)
     {
-      last_frame_index = size;
+      data_qrs[i] = is_beat;
     }
 
-    for (i = first_frame_index; i < last_frame_index; ++i)
+    if (is_beat)
     {
-      if (cur_num_samp_btwn_beats > kMinSamplesBetweenBeats)
-      {
-        if (data_lp[i] >= threshold)
-        {
-          data_qrs[i] = 1;
-          num_samp_btwn_beats[heartbeat_count] = cur_num_samp_btwn_beats;
-          cur_num_samp_btwn_beats = 0;
-          heartbeat_count++;
-        }
-        else
-        {
-          cur_num_samp_btwn_beats++;
-          data_qrs[i] = 0;
-        }
-      }
-      else
-      {
-        data_qrs[i] = 0;
-        cur_num_samp_btwn_beats++;
-      }
+      RecordBeat(beats, i);
+    }
+  }
+
+  return GetDetectorHeartrate(&detector);
+}
+
+uint16_t qrs_get_heartrate_ring(const qrs_ring_view_t* view, uint16_t* data_qrs,
+                                qrs_beats_t* beats, uint16_t size)
+{
+  qrs_params_t params;
+  FusedPipeline pipeline;
+  ThresholdStage stage;
+
+  if (0 == size)
+  {
+    return 0;
+  }
+
+  qrs_params_init(&params);
+
+  stage.params = &params;
+  stage.data_qrs = data_qrs;
+  stage.beats = beats;
+  StartBeats(beats, size);
+
+  // The first frame is filtered once to find the initial threshold and
+  // again for the detection, so no low pass output has to be stored.
+  FusedPipelineRun(&pipeline, view, &stage, params.initial_frame_size, size);
+
+  return GetDetectorHeartrate(&stage.detector);
+}
+
+void qrs_beats_init(qrs_beats_t* beats, uint16_t* bitset)
+{
+  beats->count = 0;
+  beats->bitset = bitset;
+}
+
+/**
+  @brief Return the index of a candidate of the sliding peak tracker.
+  @param  peak    The peak tracker state.
+  @param  offset  The number of candidates after the front (at most count).
+  @return The index in the ring, wrapping to 0 at QRS_PEAK_WINDOW_MAX_SIZE.
+  */
+static inline uint16_t GetPeakIndex(const qrs_peak_t* peak, uint16_t offset)
+{
+  uint16_t index;
+
+  index = peak->head + offset;
+
+  if (QRS_PEAK_WINDOW_MAX_SIZE <= index)
+  {
+    index -= QRS_PEAK_WINDOW_MAX_SIZE;
+  }
+
+  return index;
+}
+
+void qrs_peak_init(qrs_peak_t* peak, uint16_t window)
+{
+  peak->head = 0;
+  peak->count = 0;
+  peak->window = window;
+  peak->next_position = 0;
+}
+
+void qrs_peak_push(qrs_peak_t* peak, uint16_t value)
+{
+  uint16_t back;
+
+  // Drop the front once it slides out of the window.
+  if (peak->count > 0 &&
+      (uint16_t)(peak->next_position - peak->position[peak->head]) >= peak->window)
+  {
+    peak->head = GetPeakIndex(peak, 1);
+    peak->count--;
+  }
+
+  // Drop values from the back that can never be the maximum again.
+  while (peak->count > 0)
+  {
+    back = GetPeakIndex(peak, peak->count - 1);
+    if (peak->value[back] > value)
+    {
+      break;
     }
+    peak->count--;
+  }
 
-    new_peak = GetPeak(first_frame_index, last_frame_index, data_lp, size);
-    threshold = CalculateNewThreshold(threshold, new_peak);
+  back = GetPeakIndex(peak, peak->count);
+  peak->value[back] = value;
+  peak->position[back] = peak->next_position;
+  peak->count++;
+  peak->next_position++;
+}
+
+uint16_t qrs_peak_get(const qrs_peak_t* peak)
+{
+  if (0 == peak->count)
+  {
+    return 0;
   }
 
-  // Do not use the first number of samples between heartbeats
-  // because it is actually the number of samples from the starting
-  // to the first heartbeat. Therefore unreliable to use.
-  for (i = 1; i < heartbeat_count; ++i)
+  return peak->value[peak->head];
+}
+
+void qrs_stream_init(qrs_stream_t* stream, const qrs_params_t* params)
+{
+  uint16_t i;
+
+  if (params)
   {
-    heartbeat_rate += kSecondsTimesSampFreq / num_samp_btwn_beats[i];
+    stream->params = *params;
+  }
+  else
+  {
+    qrs_params_init(&stream->params);
   }
 
-  // Get the average heartrate.
-  heartbeat_rate /= heartbeat_count - 1;
+  for (i = 0; i < QRS_HIGH_PASS_WINDOW_SIZE; ++i)
+  {
+    stream->hp_window[i] = 0;
+  }
 
-  return heartbeat_rate;
+  for (i = 0; i < QRS_LOW_PASS_WINDOW_SIZE; ++i)
+  {
+    stream->lp_window[i] = 0;
+  }
+
+  stream->lp_sum = 0;
+  stream->hp_sum = 0;
+  stream->hp_index = 0;
+  stream->lp_index = 0;
+  stream->lp_count = 0;
+  stream->is_primed = 0;
+  stream->is_detecting = 0;
+  stream->threshold = 0;
+  stream->frame_peak = 0;
+  stream->frame_count = 0;
+  stream->samp_since_beat = 0;
+  stream->samp_btwn_beats = 0;
+  stream->beat_count = 0;
+  qrs_hrv_init(&stream->hrv);
+}
+
+uint16_t qrs_stream_push(qrs_stream_t* stream, uint16_t sample)
+{
+  uint16_t y1_n;
+  uint16_t y2_n;
+  uint16_t hp_n;
+  uint16_t lp_n;
+  uint32_t hp_n_squared;
+  uint16_t is_beat;
+  uint16_t i;
+
+  // Reuse the first sample for the terms before the start of the stream.
+  if (!stream->is_primed)
+  {
+    for (i = 0; i < QRS_HIGH_PASS_WINDOW_SIZE; ++i)
+    {
+      stream->hp_window[i] = sample;
+    }
+    stream->hp_sum = (qrs_hp_sum_t)sample << kHighPassWindowSizePowerOfTwo;
+    stream->is_primed = 1;
+  }
+
+  // Slide the high pass window by replacing the oldest sample.
+  stream->hp_sum -= stream->hp_window[stream->hp_index];
+  stream->hp_sum += sample;
+  stream->hp_window[stream->hp_index] = sample;
+  stream->hp_index = (stream->hp_index + 1) & (QRS_HIGH_PASS_WINDOW_SIZE - 1);
+
+  // y2[n] = x[n - (M+1)/2] is (M+1)/2 entries before the newest sample.
+  y1_n = stream->hp_sum >> kHighPassWindowSizePowerOfTwo;
+  y2_n = stream->hp_window[(stream->hp_index - 1 - (QRS_HIGH_PASS_WINDOW_SIZE + 1) / 2) &
+                           (QRS_HIGH_PASS_WINDOW_SIZE - 1)];
+  hp_n = (y2_n > y1_n) ? y2_n - y1_n : 0;
+
+  // Slide the low pass window by replacing the oldest squared term.
+  hp_n_squared = square(hp_n);
+  stream->lp_sum -= stream->lp_window[stream->lp_index];
+  stream->lp_sum += hp_n_squared;
+  stream->lp_window[stream->lp_index] = hp_n_squared;
+  stream->lp_index = (stream->lp_index + 1) & (QRS_LOW_PASS_WINDOW_SIZE - 1);
+
+  // The low pass output needs a full window of high pass outputs.
+  if (stream->lp_count < QRS_LOW_PASS_WINDOW_SIZE)
+  {
+    stream->lp_count++;
+    if (stream->lp_count < QRS_LOW_PASS_WINDOW_SIZE)
+    {
+      return 0;
+    }
+  }
+
+  lp_n = ScaleLowPass(stream->lp_sum);
+
+  if (lp_n > stream->frame_peak)
+  {
+    stream->frame_peak = lp_n;
+  }
+  stream->frame_count++;
+
+  // The initial threshold is the largest value of the first frame.
+  if (!stream->is_detecting)
+  {
+    if (stream->frame_count >= stream->params.initial_frame_size)
+    {
+      stream->threshold = stream->frame_peak;
+      stream->frame_peak = 0;
+      stream->frame_count = 0;
+      stream->is_detecting = 1;
+    }
+    return 0;
+  }
+
+  is_beat = 0;
+
+  if (stream->samp_since_beat > stream->params.min_samples_between_beats &&
+      lp_n >= stream->threshold)
+  {
+    stream->samp_btwn_beats = stream->samp_since_beat;
+    stream->samp_since_beat = 0;
+    if (stream->beat_count < 0xFFFF)
+    {
+      stream->beat_count++;
+    }
+
+    // The first interval is from the start of detection.
+    if (stream->beat_count > 1)
+    {
+      qrs_hrv_push(&stream->hrv, stream->samp_btwn_beats);
+    }
+    is_beat = 1;
+  }
+  else if (stream->samp_since_beat < 0xFFFF)
+  {
+    stream->samp_since_beat++;
+  }
+
+  // Update the threshold at the end of each decision frame.
+  if (stream->frame_count >= stream->params.decide_frame_size)
+  {
+    stream->threshold = CalculateNewThreshold(&stream->params, stream->threshold,
+                                              stream->frame_peak);
+    stream->frame_peak = 0;
+    stream->frame_count = 0;
+  }
+
+  return is_beat;
 }
 
+uint16_t qrs_stream_get_heartrate(const qrs_stream_t* stream)
+{
+  // The first interval is from the start of detection to the first
+  // heartbeat. Therefore unreliable to use.
+  if (stream->beat_count < 2)
+  {
+    return 0;
+  }
+
+  return GetBeatsPerMinute(stream->samp_btwn_beats);
+}
+
+void qrs_hrv_init(qrs_hrv_t* hrv)
+{
+  hrv->rr_sum = 0;
+  hrv->rr_square_sum = 0;
+  hrv->diff_square_sum = 0;
+  hrv->nn50_count = 0;
+  hrv->head = 0;
+  hrv->count = 0;
+}
+
+void qrs_hrv_push(qrs_hrv_t* hrv, uint16_t rr)
+{
+  uint16_t oldest;
+  uint16_t diff;
+
+  // Drop the oldest interval and its difference to the next interval.
+  if (QRS_HRV_WINDOW_SIZE == hrv->count)
+  {
+    oldest = hrv->rr[hrv->head];
+    hrv->head = (hrv->head + 1) & (QRS_HRV_WINDOW_SIZE - 1);
+    hrv->count--;
+
+    hrv->rr_sum -= oldest;
+    hrv->rr_square_sum -= (uint32_t)oldest * oldest;
+
+    diff = GetIntervalDifference(hrv->rr[hrv->head], oldest);
+    hrv->diff_square_sum -= (uint32_t)diff * diff;
+    hrv->nn50_count -= IsNn50(diff);
+  }
+
+  // Add the difference to the newest interval.
+  if (hrv->count > 0)
+  {
+    diff = GetIntervalDifference(rr, hrv->rr[(hrv->head + hrv->count - 1) & (QRS_HRV_WINDOW_SIZE - 1)]);
+    hrv->diff_square_sum += (uint32_t)diff * diff;
+    hrv->nn50_count += IsNn50(diff);
+  }
+
+  hrv->rr[(hrv->head + hrv->count) & (QRS_HRV_WINDOW_SIZE - 1)] = rr;
+  hrv->count++;
+
+  hrv->rr_sum += rr;
+  hrv->rr_square_sum += (uint32_t)rr * rr;
+}
+
+uint16_t qrs_hrv_get_heartrate(const qrs_hrv_t* hrv)
+{
+  if (0 == hrv->count)
+  {
+    return 0;
+  }
+
+  // Every interval is long enough for the table, so the rounded mean is.
+  return GetBeatsPerMinute((hrv->rr_sum + hrv->count / 2) / hrv->count);
+}
+
+uint16_t qrs_hrv_get_sdnn(const qrs_hrv_t* hrv)
+{
+  uint64_t variance;
+
+  if (hrv->count < 2)
+  {
+    return 0;
+  }
+
+  // The sample variance is (n * sum(rr^2) - sum(rr)^2) / (n * (n - 1)).
+  // It is scaled by 16^2 so the square root is in 1/16 samples.
+  variance = hrv->count * hrv->rr_square_sum - (uint64_t)hrv->rr_sum * hrv->rr_sum;
+  variance = (variance << 8) / ((uint32_t)hrv->count * (hrv->count - 1));
+
+  return DeviationToMilliseconds(SquareRoot(variance));
+}
+
+uint16_t qrs_hrv_get_rmssd(const qrs_hrv_t* hrv)
+{
+  if (hrv->count < 2)
+  {
+    return 0;
+  }
+
+  // Scaled by 16^2 so the square root is in 1/16 samples.
+  return DeviationToMilliseconds(SquareRoot((hrv->diff_square_sum << 8) / (hrv->count - 1)));
+}
+
+uint16_t qrs_hrv_get_pnn50(const qrs_hrv_t* hrv)
+{
+  if (hrv->count < 2)
+  {
+    return 0;
+  }
+
+  return ((uint32_t)hrv->nn50_count * 100 + (hrv->count - 1) / 2) / (hrv->count - 1);
+}
@@ -3,6 +3,225 @@
 
 #include <stdint.h>
 
+// The detector keeps no state between calls outside of the structures passed
+// to it, and the tables it reads are constant. Separate qrs_stream_t (and
+// other) objects can be used on different threads at the same time. Each
+// object must only be used by one thread at a time.
+
+/**
+  @brief The sampling frequency (in Hz) the detector is built for.
+  @note Override on the command line (e.g. -DQRS_SAMPLING_FREQUENCY=360).
+        All window sizes are derived from it at compile time. 128, 256, 360
+        and 500 Hz are supported, as is any frequency from 64 to 1000 Hz.
+  */
+#ifndef QRS_SAMPLING_FREQUENCY
+#define QRS_SAMPLING_FREQUENCY 256
+#endif
+
+#if QRS_SAMPLING_FREQUENCY < 64 || QRS_SAMPLING_FREQUENCY > 1000
+#error "QRS_SAMPLING_FREQUENCY must be from 64 to 1000 Hz."
+#endif
+
+// The window sizes are kept powers of two so the averages are shifts. They
+// double with every doubling of the sampling frequency. The boundaries are
+// chosen so 360 Hz uses the same windows as 500 Hz, since a 16 sample high
+// pass window (44 ms at 360 Hz) is narrower than the QRS and misses beats.
+#if QRS_SAMPLING_FREQUENCY < 91
+#define QRS_HIGH_PASS_WINDOW_SHIFT 2
+#elif QRS_SAMPLING_FREQUENCY < 181
+#define QRS_HIGH_PASS_WINDOW_SHIFT 3
+#elif QRS_SAMPLING_FREQUENCY < 300
+#define QRS_HIGH_PASS_WINDOW_SHIFT 4
+#elif QRS_SAMPLING_FREQUENCY < 600
+#define QRS_HIGH_PASS_WINDOW_SHIFT 5
+#else
+#define QRS_HIGH_PASS_WINDOW_SHIFT 6
+#endif
+
+/**
+  @brief Width of the moving average window for the high pass filter.
+  @note A power of two (16 at 256 Hz).
+  */
+#define QRS_HIGH_PASS_WINDOW_SIZE (1 << QRS_HIGH_PASS_WINDOW_SHIFT)
+
+/**
+  @brief Width of the moving summation for the low pass filter.
+  @note A power of two (32 at 256 Hz).
+  */
+#define QRS_LOW_PASS_WINDOW_SIZE (2 << QRS_HIGH_PASS_WINDOW_SHIFT)
+
+/**
+  @brief Right shift of the low pass sum.
+  @note Scales wider low pass windows back to the 32 sample sum the
+        thresholds were tuned with, so the output does not saturate.
+  */
+#if QRS_HIGH_PASS_WINDOW_SHIFT > 4
+#define QRS_LOW_PASS_OUTPUT_SHIFT (QRS_HIGH_PASS_WINDOW_SHIFT - 4)
+#else
+#define QRS_LOW_PASS_OUTPUT_SHIFT 0
+#endif
+
+/**
+  @brief Type of the moving sum of the high pass filter.
+  @note 16 12-bit samples fit in 16 bits. Larger windows need 32 bits.
+  */
+#if QRS_HIGH_PASS_WINDOW_SHIFT <= 4
+typedef uint16_t qrs_hp_sum_t;
+#else
+typedef uint32_t qrs_hp_sum_t;
+#endif
+
+/**
+  @brief Convert a number of samples tuned at 256 Hz to QRS_SAMPLING_FREQUENCY.
+  @note Rounds to the nearest sample. Usable in #if and constant expressions.
+  */
+#define QRS_SAMPLES_FROM_256_HZ(samples) \
+  (((samples) * 1L * QRS_SAMPLING_FREQUENCY + 128) / 256)
+
+/**
+  @brief Largest window supported by the sliding peak tracker.
+  @note The width of the decision frame (200 samples at 256 Hz). The deque
+        never holds more candidates than its window, so the ring is sized by
+        the window and not rounded up to a power of two.
+  */
+#define QRS_PEAK_WINDOW_MAX_SIZE QRS_SAMPLES_FROM_256_HZ(200)
+
+/**
+  @brief Sliding maximum over the last window values pushed.
+  @note A monotonic deque of values that are decreasing from the front to the
+        back. Each value is added and removed at most once, so the maximum of
+        any window length costs O(1) amortized per value.
+  */
+typedef struct {
+  uint16_t value[QRS_PEAK_WINDOW_MAX_SIZE];    // Ring of candidate values.
+  uint16_t position[QRS_PEAK_WINDOW_MAX_SIZE]; // Push count of each candidate.
+  uint16_t head;          // Index of the front (the maximum).
+  uint16_t count;         // Number of candidates.
+  uint16_t window;        // Number of values covered by the maximum.
+  uint16_t next_position; // Push count of the next value (wrapping).
+} qrs_peak_t;
+
+/**
+  @brief A view of a window of a circular buffer.
+  @note The window starts at base[start] and wraps from the end of base back
+        to base[0]. The length of the window is given separately.
+        Raw ECG samples may instead be packed as 12 bits each (two samples
+        in three bytes, see ring_init_packed). Only the high pass filter and
+        qrs_get_heartrate_ring read packed views.
+  */
+typedef struct {
+  uint16_t* base;        // The storage of the circular buffer or NULL if packed.
+  const uint8_t* packed; // The packed storage of the circular buffer or NULL.
+  uint16_t capacity;     // The number of samples in base.
+  uint16_t start;        // The index in base of the first sample of the window.
+} qrs_ring_view_t;
+
+/**
+  @brief Most heartbeat positions recorded by one batch detection.
+  @note 1250 samples at 256 Hz hold at most 17 heartbeats.
+  */
+#ifndef QRS_BEATS_MAX_COUNT
+#define QRS_BEATS_MAX_COUNT 32
+#endif
+
+/**
+  @brief The most heartbeats a batch detection averages the heart rate over.
+  @note The first interval is not used, so one less interval.
+  */
+#define QRS_MAX_AVERAGED_BEATS 16
+
+/**
+  @brief Number of words of a bitset with one bit per sample.
+  */
+#define QRS_BITSET_WORDS(size) (((size) + 15) / 16)
+
+/**
+  @brief The positions of the heartbeats found by a batch detection.
+  @note A compact alternative to a full-length array of 0/1 markers.
+        Initialize with qrs_beats_init.
+  */
+typedef struct {
+  uint16_t index[QRS_BEATS_MAX_COUNT]; // Sample index of each heartbeat.
+  uint16_t count;   // Number of entries of index. Later heartbeats are dropped.
+  uint16_t* bitset; // Optional bit per sample (QRS_BITSET_WORDS) or NULL.
+} qrs_beats_t;
+
+/**
+  @brief Number of heartbeat intervals kept for the heart rate variability.
+  @note A power of two. 64 intervals is about 50 s at 77 HBpm.
+  */
+#ifndef QRS_HRV_WINDOW_SIZE
+#define QRS_HRV_WINDOW_SIZE 64
+#endif
+
+/**
+  @brief Heart rate and heart rate variability over the last heartbeat intervals.
+  @note The sums are updated as each interval enters and leaves the window,
+        so adding an interval costs O(1) and the statistics can be read at any
+        time. The sums are exact integers. The getters divide, so they are
+        meant to be called at the display rate rather than per sample.
+  */
+typedef struct {
+  uint16_t rr[QRS_HRV_WINDOW_SIZE]; // Ring of intervals (in samples).
+  uint32_t rr_sum;          // Sum of the intervals.
+  uint64_t rr_square_sum;   // Sum of the squared intervals.
+  uint64_t diff_square_sum; // Sum of the squared successive differences.
+  uint16_t nn50_count;      // Successive differences over 50 ms.
+  uint16_t head;            // Index of the oldest interval.
+  uint16_t count;           // Number of intervals.
+} qrs_hrv_t;
+
+/**
+  @brief The tuning of the threshold detection.
+  @note qrs_params_init sets the values tuned at 256 Hz, scaled to
+        QRS_SAMPLING_FREQUENCY. The frame sizes are in low pass outputs.
+        The filter windows are fixed at compile time since they size the
+        detector state.
+  */
+typedef struct {
+  uint16_t alpha_times_gamma;  // Weight of the frame peak, scaled by 2^10.
+  uint16_t one_minus_alpha;    // Weight of the old threshold, scaled by 2^10.
+  uint16_t initial_frame_size; // Frame the initial threshold is the peak of.
+  uint16_t decide_frame_size;  // Frame between threshold updates.
+  uint16_t peak_window_size;   // Batch peak window (<= QRS_PEAK_WINDOW_MAX_SIZE).
+  uint16_t min_samples_between_beats; // Shortest heartbeat interval minus one.
+} qrs_params_t;
+
+/**
+  @brief State of the streaming QRS detector.
+  @note The high pass, low pass and threshold state is carried forward from
+        one sample to the next so each sample is processed exactly once.
+        Initialize with qrs_stream_init before pushing samples. The state has
+        a fixed size and holds no pointers, so it can be copied.
+  */
+typedef struct {
+  qrs_params_t params;      // The tuning.
+  uint16_t hp_window[QRS_HIGH_PASS_WINDOW_SIZE]; // Last raw samples.
+  uint32_t lp_window[QRS_LOW_PASS_WINDOW_SIZE];  // Last squared high pass outputs.
+  uint32_t lp_sum;          // Sum of lp_window.
+  qrs_hp_sum_t hp_sum;      // Sum of hp_window.
+  uint16_t hp_index;        // Index of the oldest entry of hp_window.
+  uint16_t lp_index;        // Index of the oldest entry of lp_window.
+  uint16_t lp_count;        // Number of entries of lp_window that are filled.
+  uint16_t is_primed;       // Set once the first sample has been pushed.
+  uint16_t is_detecting;    // Set once the initial threshold is known.
+  uint16_t threshold;       // The current detection threshold.
+  uint16_t frame_peak;      // Largest low pass output in the current frame.
+  uint16_t frame_count;     // Number of low pass outputs in the current frame.
+  uint16_t samp_since_beat; // Number of samples since the last heartbeat.
+  uint16_t samp_btwn_beats; // Number of samples between the last two heartbeats.
+  uint16_t beat_count;      // Number of heartbeats detected (saturating).
+  qrs_hrv_t hrv;            // Heartbeat intervals after the first heartbeat.
+} qrs_stream_t;
+
+/**
+  @brief Copy the window of a view into an array.
+  @param view      The view, which may be packed.
+  @param data      The unpacked samples.
+  @param size      The size of the window and the output array.
+  */
+void qrs_ring_view_copy(const qrs_ring_view_t* view, uint16_t* data, uint16_t size);
+
 /**
   @brief Return the filtered ECG signal using a linear high pass filter with
          a moving average.
@@ -14,11 +233,21 @@
   */
 void qrs_filter_high_pass(uint16_t* data, uint16_t* data_hp, uint16_t size);
 
+/**
+  @brief Same as qrs_filter_high_pass but reads the raw ECG signal from a
+         window of a circular buffer, so it does not need to be unrolled.
+  @param view      The view of the raw ECG signal.
+  @param data_hp   The high pass filtered output.
+  @param size      The size of the window and the output array.
+  */
+void qrs_filter_high_pass_ring(const qrs_ring_view_t* view, uint16_t* data_hp, uint16_t size);
+
 /**
   @brief Return the filtered ECG signal using a non-linear low pass filter.
   @param data_hp   The high pass filtered ECG signal.
   @param data_lp   The low pass filtered output.
   @param size      The size of both arrays.
+  @note data_lp may be the same array as data_hp.
   @note The equation is given below: (M is the window size for low-pass)
         z_sum[0] = data[0]^2 + data[1]^2 + data[2]^2 + ... + data[M-1]^2
         z_sum[1] = data[1]^2 + data[2]^2 + data[3]^2 + ... + data[M]^2
@@ -33,15 +262,151 @@ void qrs_filter_high_pass(uint16_t* data, uint16_t* data_hp, uint16_t size);
   */
 void qrs_filter_low_pass(uint16_t* data_hp, uint16_t* data_lp, uint16_t size);
 
+/**
+  @brief Same as qrs_filter_low_pass but reads the high pass filtered signal
+         from a window of a circular buffer.
+  @param view      The view of the high pass filtered ECG signal.
+  @param data_lp   The low pass filtered output.
+  @param size      The size of the window and the output array.
+  */
+void qrs_filter_low_pass_ring(const qrs_ring_view_t* view, uint16_t* data_lp, uint16_t size);
+
 /**
   @brief Return the number of heartbeats found in the filtered ECG sample.
   @param  data_lp  The low pass filtered output.
+  @param  data_qrs  Set to 1 where a heartbeat is detected, otherwise 0.
+                    May be NULL if the markers are not needed. This is a
+                    debugging aid; beats is much smaller.
+  @param  beats  Set to the positions of the heartbeats. May be NULL.
   @param  size  The size of both arrays.
   @return The umber of heartbeats found.
   @note The equation is given below:
         threshold = alpha * gamma * peak + (1-alpha) * threshold
   */
-uint16_t qrs_get_heartrate(uint16_t* data_lp, uint16_t* data_qrs, uint16_t size);
+uint16_t qrs_get_heartrate(uint16_t* data_lp, uint16_t* data_qrs, qrs_beats_t* beats, uint16_t size);
+
+/**
+  @brief Same as running qrs_filter_high_pass_ring, qrs_filter_low_pass and
+         qrs_get_heartrate, fused into one pass over the raw ECG signal.
+  @param  view  The view of the raw ECG signal.
+  @param  data_qrs  Set to 1 where a heartbeat is detected, otherwise 0.
+                    May be NULL if the markers are not needed.
+  @param  beats  Set to the positions of the heartbeats. May be NULL.
+  @param  size  The size of the window.
+  @return The average heart rate.
+  @note No intermediate arrays are used. The high pass and low pass filters
+        only keep short delay lines, so the memory used does not depend on
+        size. The first kQrsInitialFrameSize outputs are filtered twice to
+        find the initial threshold.
+  */
+uint16_t qrs_get_heartrate_ring(const qrs_ring_view_t* view, uint16_t* data_qrs,
+                                qrs_beats_t* beats, uint16_t size);
+
+/**
+  @brief Prepare heartbeat positions for a batch detection.
+  @param beats     The heartbeat positions.
+  @param bitset    NULL, or QRS_BITSET_WORDS(size) words. Bit (i % 16) of
+                   word (i / 16) is set for a heartbeat at sample i.
+  */
+void qrs_beats_init(qrs_beats_t* beats, uint16_t* bitset);
+
+/**
+  @brief Reset the sliding peak tracker.
+  @param peak      The peak tracker state.
+  @param window    The window length (1 to QRS_PEAK_WINDOW_MAX_SIZE).
+  */
+void qrs_peak_init(qrs_peak_t* peak, uint16_t window);
+
+/**
+  @brief Slide the peak tracker window forward to include the next value.
+  @param peak      The peak tracker state.
+  @param value     The next value of the signal being tracked.
+  */
+void qrs_peak_push(qrs_peak_t* peak, uint16_t value);
+
+/**
+  @brief Return the largest value in the window of the peak tracker.
+  @param  peak  The peak tracker state.
+  @return The largest of the last window values pushed or 0 if no values
+          have been pushed.
+  */
+uint16_t qrs_peak_get(const qrs_peak_t* peak);
+
+/**
+  @brief Set the tuning to the defaults.
+  @param params    The tuning.
+  @note The batch detectors always use the defaults.
+  */
+void qrs_params_init(qrs_params_t* params);
+
+/**
+  @brief Reset the streaming QRS detector.
+  @param stream    The detector state.
+  @param params    The tuning, copied into the state, or NULL for the defaults.
+  */
+void qrs_stream_init(qrs_stream_t* stream, const qrs_params_t* params);
+
+/**
+  @brief Push one raw ECG sample through the streaming QRS detector.
+  @param  stream  The detector state.
+  @param  sample  The raw ECG sample.
+  @return 1 if a heartbeat was detected on this sample, otherwise 0.
+  @note Does a constant amount of work per sample. No heartbeats are reported
+        until the initial frame has been seen to set the first threshold.
+  */
+uint16_t qrs_stream_push(qrs_stream_t* stream, uint16_t sample);
+
+/**
+  @brief Return the heart rate from the last two heartbeats of the stream.
+  @note The statistics of the last QRS_HRV_WINDOW_SIZE intervals are in
+        stream->hrv (see qrs_hrv_get_heartrate).
+  @param  stream  The detector state.
+  @return The heart rate in beats per minute or 0 if fewer than two
+          heartbeats have been detected.
+  */
+uint16_t qrs_stream_get_heartrate(const qrs_stream_t* stream);
+
+/**
+  @brief Reset the heart rate variability statistics.
+  @param hrv       The statistics.
+  */
+void qrs_hrv_init(qrs_hrv_t* hrv);
+
+/**
+  @brief Add a heartbeat interval, dropping the oldest once the window is full.
+  @param hrv       The statistics.
+  @param rr        The number of samples between two heartbeats. Must be
+                   more than the minimum number of samples between heartbeats.
+  */
+void qrs_hrv_push(qrs_hrv_t* hrv, uint16_t rr);
+
+/**
+  @brief Return the heart rate of the mean interval.
+  @param  hrv  The statistics.
+  @return The mean heart rate in beats per minute or 0 without intervals.
+  */
+uint16_t qrs_hrv_get_heartrate(const qrs_hrv_t* hrv);
+
+/**
+  @brief Return the standard deviation of the intervals (SDNN).
+  @param  hrv  The statistics.
+  @return SDNN in milliseconds or 0 with fewer than two intervals.
+  */
+uint16_t qrs_hrv_get_sdnn(const qrs_hrv_t* hrv);
+
+/**
+  @brief Return the root mean square of the successive differences (RMSSD).
+  @param  hrv  The statistics.
+  @return RMSSD in milliseconds or 0 with fewer than two intervals.
+  */
+uint16_t qrs_hrv_get_rmssd(const qrs_hrv_t* hrv);
+
+/**
+  @brief Return the share of successive differences over 50 ms (pNN50).
+  @param  hrv  The statistics.
+  @return pNN50 in percent or 0 with fewer than two intervals.
+  */
+uint16_t qrs_hrv_get_pnn50(const qrs_hrv_t* hrv);
 
 #endif // QRS_H
 
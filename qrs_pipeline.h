@@ -0,0 +1,258 @@
+#ifndef QRS_PIPELINE_H_
+#define QRS_PIPELINE_H_
+
+#include <stdint.h>
+
+// Compile-time composition of the detector into one fused loop.
+// A stage is a state type and static inline functions named after it, so
+// the compiler inlines the whole chain and no intermediate arrays or
+// function pointers are needed. The templates below are instantiated with
+// their window sizes as constant macro arguments, and QRS_PIPELINE ties a
+// source, a high pass, a low pass and a detector stage together. A stage
+// is swapped by naming another stage of the same kind.
+//
+// Stage contracts, for a stage named S:
+//   Source:    S, S##Input, uint16_t S##Start(S*, const S##Input*) returns
+//              the first sample without consuming it, uint16_t S##Next(S*).
+//   Filter:    S, void S##Start(S*, uint16_t first) starts the history (a
+//              filter with no delay pads it with the first input),
+//              uint16_t S##Next(S*, uint16_t), and
+//              k##S##Delay, the number of later inputs an output needs.
+//   Detector:  S, void S##Start(S*, uint16_t threshold) with the peak of the
+//              first frame, void S##Next(S*, uint16_t lp_n, uint16_t n).
+//
+// A filter with a delay D is run D inputs ahead. Past the last input it is
+// fed its last input again, so output n of a window depends only on the
+// window, as with the array filters of qrs.h.
+
+/**
+  @brief Define a source stage that reads a uint16_t array.
+  */
+#define QRS_PIPELINE_ARRAY_SOURCE(name)                                       \
+  typedef uint16_t name##Input;                                               \
+  typedef struct {                                                            \
+    const uint16_t* next; /* The next sample. */                              \
+  } name;                                                                     \
+                                                                              \
+  static inline uint16_t name##Start(name* source, const name##Input* input)  \
+  {                                                                           \
+    source->next = input;                                                     \
+    return *input;                                                            \
+  }                                                                           \
+                                                                              \
+  static inline uint16_t name##Next(name* source)                             \
+  {                                                                           \
+    return *source->next++;                                                   \
+  }
+
+/**
+  @brief Define the moving average high pass filter with a window of
+         1 << shift samples (see qrs_filter_high_pass).
+  @param name     The name of the stage.
+  @param shift    The log2 of the window size.
+  @param sum_type The type of the moving sum (see qrs_hp_sum_t).
+  @note y[n] = data[n - M/2] - mean(data[n - M + 1 .. n]), clamped at 0.
+  */
+#define QRS_PIPELINE_HIGH_PASS(name, shift, sum_type)                         \
+  enum { k##name##Delay = 0 };                                                \
+                                                                              \
+  typedef struct {                                                            \
+    uint16_t history[1 << (shift)]; /* data[k] at k % M. */                   \
+    sum_type y1_sum;                /* The moving sum. */                     \
+    uint16_t n;                     /* The index of the next output. */       \
+  } name;                                                                     \
+                                                                              \
+  static inline void name##Start(name* hp, uint16_t first)                    \
+  {                                                                           \
+    uint16_t i;                                                               \
+                                                                              \
+    for (i = 0; i < (1 << (shift)); ++i)                                      \
+    {                                                                         \
+      hp->history[i] = first;                                                 \
+    }                                                                         \
+    hp->y1_sum = (sum_type)first << (shift);                                  \
+    hp->n = 0;                                                                \
+  }                                                                           \
+                                                                              \
+  static inline uint16_t name##Next(name* hp, uint16_t x)                     \
+  {                                                                           \
+    uint16_t slot;                                                            \
+    uint16_t y1_n;                                                            \
+    uint16_t y2_n;                                                            \
+                                                                              \
+    /* The slot of data[n] still holds data[n-M]. */                          \
+    slot = hp->n & ((1 << (shift)) - 1);                                      \
+    hp->y1_sum = hp->y1_sum - hp->history[slot] + x;                          \
+    y1_n = hp->y1_sum >> (shift);                                             \
+    y2_n = hp->history[(hp->n - (1 << (shift)) / 2) & ((1 << (shift)) - 1)];  \
+    hp->history[slot] = x;                                                    \
+    hp->n++;                                                                  \
+                                                                              \
+    return (y2_n > y1_n) ? y2_n - y1_n : 0;                                   \
+  }
+
+/**
+  @brief Define a moving sum low pass filter over 1 << shift terms.
+  @param name          The name of the stage.
+  @param shift         The log2 of the window size.
+  @param output_shift  The right shift of the sum (see QRS_LOW_PASS_OUTPUT_SHIFT).
+  @param term          A macro of the term of each input, such as
+                       QRS_PIPELINE_SQUARE or QRS_PIPELINE_IDENTITY.
+  @note z[n] = sum(term(hp[n .. n + M - 1])) >> output_shift, saturated at
+        0xFFFF.
+  */
+#define QRS_PIPELINE_MOVING_SUM(name, shift, output_shift, term)              \
+  enum { k##name##Delay = (1 << (shift)) - 1 };                               \
+                                                                              \
+  typedef struct {                                                            \
+    uint32_t terms[1 << (shift)]; /* The last M terms. */                     \
+    uint32_t z_sum;               /* The sum of terms. */                     \
+    uint16_t n;                   /* The index of the next input. */          \
+  } name;                                                                     \
+                                                                              \
+  static inline void name##Start(name* lp, uint16_t first)                    \
+  {                                                                           \
+    uint16_t i;                                                               \
+                                                                              \
+    (void)first;                                                              \
+    for (i = 0; i < (1 << (shift)); ++i)                                      \
+    {                                                                         \
+      lp->terms[i] = 0;                                                       \
+    }                                                                         \
+    lp->z_sum = 0;                                                            \
+    lp->n = 0;                                                                \
+  }                                                                           \
+                                                                              \
+  static inline uint16_t name##Next(name* lp, uint16_t hp_n)                  \
+  {                                                                           \
+    uint32_t z_n;                                                             \
+    uint16_t index;                                                           \
+                                                                              \
+    /* Slide the window by replacing the oldest term with the newest. */      \
+    index = lp->n & ((1 << (shift)) - 1);                                     \
+    lp->z_sum -= lp->terms[index];                                            \
+    lp->terms[index] = term(hp_n);                                            \
+    lp->z_sum += lp->terms[index];                                            \
+    lp->n++;                                                                  \
+                                                                              \
+    z_n = lp->z_sum >> (output_shift);                                        \
+    return (z_n > 0xFFFF) ? 0xFFFF : z_n;                                     \
+  }
+
+/**
+  @brief The term of the squared sum low pass filter (see qrs_filter_low_pass).
+  */
+#define QRS_PIPELINE_SQUARE(x) ((uint32_t)(x) * (x))
+
+/**
+  @brief The term of a plain moving sum, which needs no multiplier.
+  */
+#define QRS_PIPELINE_IDENTITY(x) ((uint32_t)(x))
+
+/**
+  @brief Define a fused pipeline of a source, a high pass filter, a low pass
+         filter and a detector.
+  @note Defines the state name, name##Start(name*, const source##Input*,
+        size), which starts a window of size samples, name##Next(name*),
+        which returns the next low pass output, and name##Run(name*,
+        const source##Input*, detector*, initial_frame_size, size), which
+        finds the initial threshold over the first frame and then runs the
+        detector over the window. The first frame is filtered twice, so no
+        low pass output is stored.
+  */
+#define QRS_PIPELINE(name, source_type, high_pass_type, low_pass_type, detector_type) \
+  typedef struct {                                                            \
+    source_type source;                                                       \
+    high_pass_type high_pass;                                                 \
+    low_pass_type low_pass;                                                   \
+    uint16_t x_n;          /* The last input of the high pass filter. */      \
+    uint16_t hp_n;         /* The last input of the low pass filter. */       \
+    uint16_t inputs_left;  /* The samples left in the source. */              \
+    uint16_t hp_left;      /* The high pass outputs left to compute. */       \
+  } name;                                                                     \
+                                                                              \
+  static inline void name##Step(name* pipeline)                               \
+  {                                                                           \
+    if (pipeline->inputs_left)                                                \
+    {                                                                         \
+      pipeline->inputs_left--;                                                \
+      pipeline->x_n = source_type##Next(&pipeline->source);                   \
+    }                                                                         \
+                                                                              \
+    if (pipeline->hp_left)                                                    \
+    {                                                                         \
+      pipeline->hp_left--;                                                    \
+      pipeline->hp_n = high_pass_type##Next(&pipeline->high_pass, pipeline->x_n); \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  static inline uint16_t name##Next(name* pipeline)                           \
+  {                                                                           \
+    uint16_t lp_n;                                                            \
+                                                                              \
+    lp_n = low_pass_type##Next(&pipeline->low_pass, pipeline->hp_n);          \
+    name##Step(pipeline);                                                     \
+                                                                              \
+    return lp_n;                                                              \
+  }                                                                           \
+                                                                              \
+  static inline void name##Start(name* pipeline, const source_type##Input* input, \
+                                 uint16_t size)                               \
+  {                                                                           \
+    uint16_t i;                                                               \
+                                                                              \
+    pipeline->x_n = source_type##Start(&pipeline->source, input);             \
+    high_pass_type##Start(&pipeline->high_pass, pipeline->x_n);               \
+    pipeline->inputs_left = size;                                             \
+    pipeline->hp_left = size + k##high_pass_type##Delay;                      \
+                                                                              \
+    /* Run the high pass filter ahead of its first output. */                 \
+    for (i = k##high_pass_type##Delay; i > 0; --i)                            \
+    {                                                                         \
+      name##Step(pipeline);                                                   \
+    }                                                                         \
+    name##Step(pipeline);                                                     \
+                                                                              \
+    /* Run the low pass filter ahead of its first output. hp_n always holds   \
+       the next input of the low pass filter. */                              \
+    low_pass_type##Start(&pipeline->low_pass, pipeline->hp_n);                \
+    for (i = k##low_pass_type##Delay; i > 0; --i)                             \
+    {                                                                         \
+      name##Next(pipeline);                                                   \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  static void name##Run(name* pipeline, const source_type##Input* input,      \
+                        detector_type* detector, uint16_t initial_frame_size, \
+                        uint16_t size)                                        \
+  {                                                                           \
+    uint16_t threshold;                                                       \
+    uint16_t lp_n;                                                            \
+    uint16_t n;                                                               \
+                                                                              \
+    if (0 == size)                                                            \
+    {                                                                         \
+      return;                                                                 \
+    }                                                                         \
+                                                                              \
+    /* The initial threshold is the largest output of the first frame. */     \
+    threshold = 0;                                                            \
+    name##Start(pipeline, input, size);                                       \
+    for (n = 0; n < initial_frame_size && n < size; ++n)                      \
+    {                                                                         \
+      lp_n = name##Next(pipeline);                                            \
+      if (lp_n > threshold)                                                   \
+      {                                                                       \
+        threshold = lp_n;                                                     \
+      }                                                                       \
+    }                                                                         \
+                                                                              \
+    detector_type##Start(detector, threshold);                                \
+    name##Start(pipeline, input, size);                                       \
+    for (n = 0; n < size; ++n)                                                \
+    {                                                                         \
+      detector_type##Next(detector, name##Next(pipeline), n);                 \
+    }                                                                         \
+  }
+
+#endif // QRS_PIPELINE_H_
@@ -0,0 +1,110 @@
+#include <stddef.h>
+#include "ring.h"
+
+// The head and count of the ring are published from the producer to the
+// consumer. On the MSP430 aligned 16-bit accesses are atomic and there is a
+// single in-order CPU, so volatile accesses are enough. On a host the
+// accesses need acquire and release ordering.
+#ifdef __MSP430__
+#define RingLoadAcquire(pointer) (*(volatile uint16_t*)(pointer))
+#define RingStoreRelease(pointer, value) (*(volatile uint16_t*)(pointer) = (value))
+#define RingFenceAcquire()
+#else
+#define RingLoadAcquire(pointer) __atomic_load_n(pointer, __ATOMIC_ACQUIRE)
+#define RingStoreRelease(pointer, value) __atomic_store_n(pointer, value, __ATOMIC_RELEASE)
+#define RingFenceAcquire() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+void ring_init(ring_t* ring, uint16_t* data, uint16_t capacity, uint16_t head)
+{
+  ring->data = data;
+  ring->packed = NULL;
+  ring->capacity = capacity;
+  ring->head = head;
+  ring->count = 0;
+}
+
+void ring_init_packed(ring_t* ring, uint8_t* data, uint16_t capacity, uint16_t head)
+{
+  ring->data = NULL;
+  ring->packed = data;
+  ring->capacity = capacity;
+  ring->head = head;
+  ring->count = 0;
+}
+
+void ring_push(ring_t* ring, uint16_t value)
+{
+  volatile uint8_t* packed;
+  uint16_t head;
+
+  head = ring->head;
+
+  if (NULL == ring->packed)
+  {
+    ring->data[head] = value;
+  }
+  else
+  {
+    // Sample i starts at byte i + i / 2 and shares the middle byte of its
+    // pair with the other sample, whose nibble is kept.
+    packed = ring->packed + head + (head >> 1);
+    if (head & 1)
+    {
+      packed[0] = (packed[0] & 0x0F) | (value << 4);
+      packed[1] = value >> 4;
+    }
+    else
+    {
+      packed[0] = value;
+      packed[1] = (packed[1] & 0xF0) | ((value >> 8) & 0x0F);
+    }
+  }
+
+  ++head;
+  if (ring->capacity <= head)
+  {
+    head = 0;
+  }
+
+  // Publish the sample only after it has been written.
+  RingStoreRelease(&ring->head, head);
+  RingStoreRelease(&ring->count, ring->count + 1);
+}
+
+uint16_t ring_get_window(ring_t* ring, uint16_t len, uint16_t* start)
+{
+  uint16_t count;
+  uint16_t head;
+
+  // The count is loaded before the head so every write after the head was
+  // loaded is included in the writes counted by ring_is_window_intact.
+  count = RingLoadAcquire(&ring->count);
+  head = RingLoadAcquire(&ring->head);
+
+  // Start len samples before the head.
+  if (head >= len)
+  {
+    *start = head - len;
+  }
+  else
+  {
+    *start = head + ring->capacity - len;
+  }
+
+  return count;
+}
+
+uint16_t ring_is_window_intact(ring_t* ring, uint16_t len, uint16_t count)
+{
+  uint16_t last_count;
+
+  // Check how far the producer got while the window was read. The window is
+  // intact if the producer stayed within the slack beyond the window. The
+  // write counted next may already have stored its sample, so it must not
+  // reach the first sample of the window either.
+  RingFenceAcquire();
+  last_count = RingLoadAcquire(&ring->count);
+
+  return (uint16_t)(last_count - count) < ring->capacity - len;
+}
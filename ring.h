@@ -0,0 +1,80 @@
+#ifndef RING_H_
+#define RING_H_
+
+#include <stdint.h>
+
+/**
+  @brief Single-producer, single-consumer ring of samples.
+  @note The producer (the ADC interrupt) never blocks or skips a sample and
+        overwrites the oldest sample when the ring is full. The consumer (the
+        main loop) reads the latest window while the producer keeps writing,
+        so the ring must be larger than the window by enough slack to cover
+        the samples written while the window is being read.
+  */
+typedef struct {
+  volatile uint16_t* data;  // The storage of the ring or NULL if packed.
+  volatile uint8_t* packed; // The packed storage of the ring or NULL.
+  uint16_t capacity;        // The number of samples in data.
+  uint16_t head;            // Index of the next write.
+  uint16_t count;           // Number of writes (wrapping). Published with release.
+} ring_t;
+
+/**
+  @brief Initialize a ring over the given storage.
+  @param ring      The ring.
+  @param data      The storage of the ring.
+  @param capacity  The number of samples in data.
+  @param head      The index of the next write. Use 0 for an empty ring.
+  */
+void ring_init(ring_t* ring, uint16_t* data, uint16_t capacity, uint16_t head);
+
+/**
+  @brief The number of bytes of packed storage for capacity 12-bit samples.
+  */
+#define RING_PACKED_SIZE(capacity) ((capacity) / 2 * 3)
+
+/**
+  @brief Initialize a ring that packs two 12-bit samples into three bytes.
+  @param ring      The ring.
+  @param data      The storage of the ring (RING_PACKED_SIZE(capacity) bytes).
+  @param capacity  The number of samples in data. Must be even.
+  @param head      The index of the next write. Use 0 for an empty ring.
+  @note Saves a quarter of the storage of ring_init for ADC12 samples. The
+        upper 4 bits of each sample are dropped.
+  */
+void ring_init_packed(ring_t* ring, uint8_t* data, uint16_t capacity, uint16_t head);
+
+/**
+  @brief Write a sample to the ring. Only called by the producer.
+  @param ring      The ring.
+  @param value     The sample.
+  */
+void ring_push(ring_t* ring, uint16_t value);
+
+/**
+  @brief Locate the latest len samples of the ring without copying them.
+  @param  ring   The ring.
+  @param  len    The number of samples in the window. Must not exceed the
+                 capacity.
+  @param  start  Set to the index in the ring storage of the oldest sample
+                 of the window.
+  @return The write count to pass to ring_is_window_intact once the window
+          has been read.
+  @note Only called by the consumer. Sampling is not disabled.
+  */
+uint16_t ring_get_window(ring_t* ring, uint16_t len, uint16_t* start);
+
+/**
+  @brief Check that a window located by ring_get_window was not overwritten.
+  @param  ring   The ring.
+  @param  len    The number of samples in the window.
+  @param  count  The write count returned by ring_get_window.
+  @return 1 if the producer stayed within the slack beyond the window since
+          the window was located, otherwise 0.
+  @note A sample is stored before its write is counted, so the write after
+        the last one counted may be in progress. The slack must cover it
+        too, which leaves capacity - len - 1 writes while the window is read.
+  */
+uint16_t ring_is_window_intact(ring_t* ring, uint16_t len, uint16_t count);
+
+#endif // RING_H_
@@ -0,0 +1,30 @@
+#include "hal.h"
+#include "trace.h"
+
+/**
+  @brief The number of the next frame.
+  */
+static uint16_t frame_number = 0;
+
+void trace_write(trace_stage_t stage, const uint16_t* data, uint16_t size)
+{
+  uint16_t header[TRACE_HEADER_SIZE / 2];
+  uint16_t checksum;
+  uint16_t i;
+
+  header[0] = TRACE_MAGIC;
+  header[1] = stage;
+  header[2] = frame_number++;
+  header[3] = size;
+
+  checksum = header[1] + header[2] + header[3];
+  for (i = 0; i < size; ++i)
+  {
+    checksum += data[i];
+  }
+
+  // The samples are sent straight from data without a copy.
+  hal_trace_write(header, sizeof(header));
+  hal_trace_write(data, size * sizeof(uint16_t));
+  hal_trace_write(&checksum, sizeof(checksum));
+}
@@ -0,0 +1,57 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+// Binary trace of the arrays of each step of the QRS detection.
+// Each array is sent through hal_trace_write (see hal.h) as one frame:
+//
+//   offset  size      field
+//   0       2         TRACE_MAGIC
+//   2       1         stage (trace_stage_t)
+//   3       1         reserved (0)
+//   4       2         frame number (wrapping)
+//   6       2         number of samples (n)
+//   8       2 * n     samples
+//   8 + 2n  2         checksum
+//
+// All fields are little-endian 16-bit words except stage and reserved. The
+// checksum is the wrapping sum of the header words from offset 2 and the
+// samples, so a frame whose samples changed while it was sent is rejected.
+// Frames of kTraceStageRecording carry a block of compressed ADC samples
+// (see codec.h) padded to whole words instead of samples.
+// host/trace_decode.c turns a trace back into CSV.
+
+/**
+  @brief The first two bytes of each frame ("QT").
+  */
+#define TRACE_MAGIC 0x5451
+
+/**
+  @brief The size of the frame header in bytes.
+  */
+#define TRACE_HEADER_SIZE 8
+
+/**
+  @brief The steps of the QRS detection that are traced.
+  */
+typedef enum {
+  kTraceStageOriginal,
+  kTraceStageHighPass,
+  kTraceStageLowPass,
+  kTraceStageQrs,
+  kTraceStageRecording,
+  kTraceNumStages
+} trace_stage_t;
+
+/**
+  @brief Send an array as one trace frame.
+  @param stage     The step of the QRS detection.
+  @param data      The samples.
+  @param size      The number of samples.
+  @note Returns once the frame is sent, so data may be changed afterwards.
+        Interrupts keep running while the frame is sent.
+  */
+void trace_write(trace_stage_t stage, const uint16_t* data, uint16_t size);
+
+#endif // TRACE_H_